@@ -7,6 +7,7 @@
 
 #include "macros.h"
 #include "displaylist.h"
+#include "driver.h"
 
 #define OBJECT_SEGMENT 6
 
@@ -21,28 +22,35 @@ int main(int argc, const char** argv)
     ZObj obj1;
     ZObj obj2;
 
-    // Read an existing ZObj
-    ZObj_Read(&obj1, "object_link_boy.zobj", OBJECT_SEGMENT);
+    // With arguments, run the jobs described by a manifest instead
+    if (argc > 1)
+        return Driver_Main(argc, argv);
+
+    // Map an existing ZObj, it is only read from so it does not need to be loaded into memory
+    ZObj_Map(&obj1, "object_link_boy.zobj", OBJECT_SEGMENT);
     // Create a new empty ZObj
     ZObj_New(&obj2, OBJECT_SEGMENT);
 
-    for (int i = 0; i < ARRLEN(seg_addrs); i++)
+    // Copy every display list in one session, so that anything they share is only copied once
+    segaddr_t newSegs[ARRLEN(seg_addrs)];
+    if (DisplayList_CopyBatch(&obj1, seg_addrs, ARRLEN(seg_addrs), &obj2, newSegs) != 0)
     {
-        segaddr_t newSeg;
-        int ret = DisplayList_Copy(&obj1, seg_addrs[i], &obj2, &newSeg);
-        if (ret != 0)
-        {
-            printf("%s\n", DisplayList_ErrMsg());
-            ZObj_Free(&obj1);
-            ZObj_Free(&obj2);
-            return EXIT_FAILURE;
-        }
-        printf("Copied to 0x%08X\n", newSeg);
+        printf("%s", DisplayList_ErrMsg());
+        ZObj_Free(&obj1);
+        ZObj_Free(&obj2);
+        return EXIT_FAILURE;
     }
+    for (int i = 0; i < ARRLEN(seg_addrs); i++)
+        printf("Copied to 0x%08X\n", newSegs[i]);
 
-    ZObj_Write(&obj2, "object_link_boy_2.zobj");
+    int ret = EXIT_SUCCESS;
+    if (ZObj_Write(&obj2, "object_link_boy_2.zobj") != 0)
+    {
+        printf("%s", DisplayList_ErrMsg());
+        ret = EXIT_FAILURE;
+    }
 
     ZObj_Free(&obj1);
     ZObj_Free(&obj2);
-    return EXIT_SUCCESS;
+    return ret;
 }
@@ -0,0 +1,361 @@
+/*
+ *  Benchmarks for the copier, run on a synthetic object
+ *
+ *  zobjbench [-d <display lists>] [-n <depth>] [-v <vertex share>] [-w <vertex overlap>] [-t <texture share>]
+ *            [-m <tlut mix>] [-s <seed>] [-i <iterations>] [-o <output.zobj>]
+ *
+ *  With -o the generated object is written out along with its root addresses in <output.zobj>.roots instead of
+ *  running the benchmarks.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "displaylist.h"
+#include "layout.h"
+#include "refgraph.h"
+#include "synth.h"
+#include "workpool.h"
+
+#define BENCH_SEGMENT 6
+#define BENCH_SEARCH_SIZE 64
+
+static double
+Bench_Now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+Bench_Report (const char* phase, double seconds, size_t bytes, size_t items, const char* itemName)
+{
+    printf("%-24s %10.3f ms %10.1f MB/s %12.0f %s/s\n", phase, seconds * 1e3, bytes / seconds / 1e6, items / seconds,
+           itemName);
+}
+
+static void
+Bench_Usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-d <display lists>] [-n <depth>] [-v <vertex share>] [-w <vertex overlap>]\n"
+            "          [-t <texture share>] [-m <tlut mix>] [-s <seed>] [-i <iterations>] [-o <output.zobj>]\n", prog);
+}
+
+static int
+Bench_WriteSource (ZObj* src, const Vector* roots, const char* path)
+{
+    char rootsPath[1024];
+    FILE* file;
+
+    if (ZObj_Write(src, path) != 0)
+    {
+        fprintf(stderr, "error: %s", DisplayList_ErrMsg());
+        return EXIT_FAILURE;
+    }
+
+    snprintf(rootsPath, sizeof(rootsPath), "%s.roots", path);
+    file = fopen(rootsPath, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "error: failed to open '%s' for writing\n", rootsPath);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < roots->limit; i++)
+        fprintf(file, "%08X\n", *(segaddr_t*)Vector_At(roots, i));
+    fclose(file);
+
+    printf("Wrote %lu bytes to %s and %lu roots to %s\n", src->limit, path, roots->limit, rootsPath);
+    return EXIT_SUCCESS;
+}
+
+int
+main (int argc, const char** argv)
+{
+    SynthParams params;
+    const char* outPath = NULL;
+    int iterations = 10;
+    Vector roots;
+    ZObj src;
+    double t;
+
+    Synth_DefaultParams(&params);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc || argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0')
+        {
+            Bench_Usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        const char* arg = argv[++i];
+        switch (argv[i - 1][1])
+        {
+            case 'd': params.numDisplayLists = atoi(arg); break;
+            case 'n': params.depth = atoi(arg);           break;
+            case 'v': params.vtxShare = atof(arg);        break;
+            case 'w': params.vtxOverlap = atof(arg);      break;
+            case 't': params.texShare = atof(arg);        break;
+            case 'm': params.tlutMix = atof(arg);         break;
+            case 's': params.seed = atoi(arg);            break;
+            case 'i': iterations = atoi(arg);             break;
+            case 'o': outPath = arg;                      break;
+            default:
+                Bench_Usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (params.numDisplayLists < 1 || params.depth < 0 || iterations < 1)
+    {
+        Bench_Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ZObj_New(&src, BENCH_SEGMENT);
+    Vector_New(&roots, sizeof(segaddr_t));
+
+    t = Bench_Now();
+    if (Synth_Generate(&src, BENCH_SEGMENT, &params, &roots) != 0 || src.limit > SEGMENT_OFFSET(-1))
+    {
+        fprintf(stderr, "error: generated object does not fit in a segment\n");
+        return EXIT_FAILURE;
+    }
+    t = Bench_Now() - t;
+
+    if (outPath != NULL)
+    {
+        int ret = Bench_WriteSource(&src, &roots, outPath);
+        ZObj_Free(&src);
+        Vector_Destroy(&roots);
+        return ret;
+    }
+
+    size_t numRoots = roots.limit;
+    segaddr_t* rootAddrs = roots.start;
+    segaddr_t* newAddrs = malloc(numRoots * sizeof(segaddr_t));
+
+    printf("Synthetic object: %d display lists, %lu roots, depth %d, %lu bytes, seed %u\n",
+           params.numDisplayLists, numRoots, params.depth, src.limit, params.seed);
+    printf("Sharing: vertices %.2f, overlapping vertices %.2f, textures %.2f, TLUT mix %.2f; "
+           "%d iterations per phase\n\n",
+           params.vtxShare, params.vtxOverlap, params.texShare, params.tlutMix, iterations);
+    Bench_Report("generate", t, src.limit, params.numDisplayLists, "DLs");
+
+    /*
+     * File I/O
+     */
+
+    char path[] = "/tmp/zobjbench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        fprintf(stderr, "error: could not create temporary file\n");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+        ZObj_Write(&src, path);
+    Bench_Report("ZObj_Write", (Bench_Now() - t) / iterations, src.limit, 1, "files");
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        ZObj obj;
+        ZObj_Read(&obj, path, BENCH_SEGMENT);
+        ZObj_Free(&obj);
+    }
+    Bench_Report("ZObj_Read", (Bench_Now() - t) / iterations, src.limit, 1, "files");
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        // touch every page so the mapping is not measured as free
+        volatile uint8_t sum = 0;
+        ZObj obj;
+        ZObj_Map(&obj, path, BENCH_SEGMENT);
+        for (size_t j = 0; j < obj.limit; j += 4096)
+            sum += ((uint8_t*)obj.buffer)[j];
+        ZObj_Free(&obj);
+    }
+    Bench_Report("ZObj_Map", (Bench_Now() - t) / iterations, src.limit, 1, "files");
+
+    src.compression = ZOBJ_COMPRESSION_YAZ0;
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+        ZObj_Write(&src, path);
+    Bench_Report("ZObj_Write yaz0", (Bench_Now() - t) / iterations, src.limit, 1, "files");
+
+    src.compressThreads = WorkPool_DefaultWorkers();
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+        ZObj_Write(&src, path);
+    Bench_Report("ZObj_Write yaz0 parallel", (Bench_Now() - t) / iterations, src.limit, 1, "files");
+    src.compression = ZOBJ_COMPRESSION_NONE;
+    src.compressThreads = 1;
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        ZObj obj;
+        ZObj_Read(&obj, path, BENCH_SEGMENT);
+        ZObj_Free(&obj);
+    }
+    Bench_Report("ZObj_Read yaz0", (Bench_Now() - t) / iterations, src.limit, 1, "files");
+
+    remove(path);
+
+    /*
+     * Display list length
+     */
+
+    size_t dlBytes = 0;
+    for (size_t j = 0; j < numRoots; j++)
+        dlBytes += DisplayList_Length(&src, rootAddrs[j]);
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (size_t j = 0; j < numRoots; j++)
+            DisplayList_Length(&src, rootAddrs[j]);
+    }
+    Bench_Report("DisplayList_Length", (Bench_Now() - t) / iterations, dlBytes, numRoots, "DLs");
+
+    /*
+     * Copying, one session per root and one session for all roots
+     */
+
+    ZObj dst;
+    int numFailed = 0;
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        ZObj_New(&dst, BENCH_SEGMENT);
+        for (size_t j = 0; j < numRoots; j++)
+            numFailed += DisplayList_Copy(&src, rootAddrs[j], &dst, &newAddrs[j]) != 0;
+        ZObj_Free(&dst);
+    }
+    Bench_Report("DisplayList_Copy", (Bench_Now() - t) / iterations, src.limit, numRoots, "roots");
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        ZObj_New(&dst, BENCH_SEGMENT);
+        numFailed += DisplayList_CopyBatch(&src, rootAddrs, numRoots, &dst, newAddrs);
+        if (i != iterations - 1)
+            ZObj_Free(&dst);
+    }
+    Bench_Report("DisplayList_CopyBatch", (Bench_Now() - t) / iterations, src.limit, numRoots, "roots");
+
+    /*
+     * Laying out the copy by type
+     */
+
+    segaddr_t* laidOutAddrs = malloc(numRoots * sizeof(segaddr_t));
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        ZObj laidOut;
+
+        ZObj_New(&laidOut, BENCH_SEGMENT);
+        numFailed += Layout_Optimize(&dst, newAddrs, numRoots, &laidOut, laidOutAddrs) != 0;
+        ZObj_Free(&laidOut);
+    }
+    Bench_Report("Layout_Optimize", (Bench_Now() - t) / iterations, dst.limit, numRoots, "roots");
+    free(laidOutAddrs);
+
+    /*
+     * Copying from a reference graph, decoded once and then copied from many times
+     */
+
+    RefGraph graph;
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        RefGraph_New(&graph, &src);
+        numFailed += RefGraph_Build(&graph, rootAddrs, numRoots, NULL);
+        if (i != iterations - 1)
+            RefGraph_Free(&graph);
+    }
+    Bench_Report("RefGraph_Build", (Bench_Now() - t) / iterations, src.limit, numRoots, "roots");
+
+    size_t graphSize = 0;
+    size_t coalescedSize = 0;
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        ZObj copy;
+
+        ZObj_New(&copy, BENCH_SEGMENT);
+        numFailed += RefGraph_Copy(&graph, rootAddrs, numRoots, &copy, newAddrs);
+        graphSize = copy.limit;
+        ZObj_Free(&copy);
+    }
+    Bench_Report("RefGraph_Copy", (Bench_Now() - t) / iterations, src.limit, numRoots, "roots");
+
+    graph.coalesceVtx = true;
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        ZObj copy;
+
+        ZObj_New(&copy, BENCH_SEGMENT);
+        numFailed += RefGraph_Copy(&graph, rootAddrs, numRoots, &copy, newAddrs);
+        coalescedSize = copy.limit;
+        ZObj_Free(&copy);
+    }
+    Bench_Report("RefGraph_Copy coalesced", (Bench_Now() - t) / iterations, src.limit, numRoots, "roots");
+    RefGraph_Free(&graph);
+
+    if (numFailed != 0)
+        fprintf(stderr, "error: %d copies failed\n%s", numFailed, DisplayList_ErrMsg());
+
+    // overlapping vertex loads are what coalescing is for, with them it has to save something
+    if (params.vtxOverlap > 0.0 && coalescedSize >= graphSize)
+    {
+        fprintf(stderr, "error: coalescing vertices gave %lu bytes, not less than the %lu bytes without\n",
+                coalescedSize, graphSize);
+        numFailed++;
+    }
+
+    /*
+     * Duplicate search against the copied object, blocks taken from all over the source so there are hits and misses
+     */
+
+    size_t numSearches = 0;
+    size_t numHits = 0;
+
+    t = Bench_Now();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (size_t off = 0; off + BENCH_SEARCH_SIZE <= src.limit; off += 256)
+        {
+            numHits += ZObj_SearchDuplicate(&dst, (uint8_t*)src.buffer + off, BENCH_SEARCH_SIZE) != NULL;
+            numSearches++;
+        }
+    }
+    t = Bench_Now() - t;
+    Bench_Report("ZObj_SearchDuplicate", t / iterations, numSearches / iterations * BENCH_SEARCH_SIZE,
+                 numSearches / iterations, "searches");
+
+    printf("\nOutput: %lu bytes, %.1f%% of the source; %.1f%% of searches hit\n",
+           dst.limit, 100.0 * dst.limit / src.limit, 100.0 * numHits / numSearches);
+    printf("RefGraph output: %lu bytes, %lu bytes with coalesced vertices (%.1f%% smaller)\n",
+           graphSize, coalescedSize, 100.0 - 100.0 * coalescedSize / graphSize);
+
+    ZObj_Free(&dst);
+    ZObj_Free(&src);
+    Vector_Destroy(&roots);
+    free(newAddrs);
+    return (numFailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,327 @@
+/*
+ *  Generator for synthetic object files, for benchmarking without proprietary game data
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "gbi.h"
+#include "synth.h"
+
+#define SYNTH_MAX_VTX 32
+
+typedef struct SynthState {
+    const SynthParams* params;
+    uint64_t rng;
+    Vector data;        // vertices, textures, palettes and matrices, placed first
+    Vector dls;         // display list commands, placed after the data
+    Vector dlFixups;    // positions in dls of G_DL commands whose target is relative to the start of dls
+    Vector vtxBlocks;   // offsets of vertex blocks in data, count in the low byte
+    Vector textures;    // offsets of texture loads, see SynthTexture
+    Vector mtxs;        // offsets of matrices in data
+} SynthState;
+
+typedef struct SynthTexture {
+    uint32_t offset;
+    uint32_t tlutOffset;
+    uint8_t siz;
+    uint8_t fmt;
+    uint16_t width;
+    uint16_t height;
+    uint16_t tlutCount;
+} SynthTexture;
+
+static uint32_t
+Synth_Rand (SynthState* state)
+{
+    // xorshift64*
+    state->rng ^= state->rng >> 12;
+    state->rng ^= state->rng << 25;
+    state->rng ^= state->rng >> 27;
+    return (state->rng * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static double
+Synth_RandUnit (SynthState* state)
+{
+    return Synth_Rand(state) / 4294967296.0;
+}
+
+static uint32_t
+Synth_AddData (SynthState* state, size_t size, int kind)
+{
+    uint32_t offset = state->data.limit;
+    uint8_t* p = Vector_PushBack(&state->data, ALIGN8(size), NULL);
+
+    memset(p, 0, ALIGN8(size));
+    for (size_t i = 0; i < size; i++)
+    {
+        // textures get a small palette of values so they look like image data, everything else is noise
+        p[i] = (kind == 1) ? Synth_Rand(state) % 5 * 0x33 : Synth_Rand(state);
+    }
+    return offset;
+}
+
+static void
+Synth_Cmd (SynthState* state, uint32_t w0, uint32_t w1)
+{
+    uint8_t* p = Vector_PushBack(&state->dls, 1, NULL);
+
+    WRITE_32_BE(p, 0, w0);
+    WRITE_32_BE(p, 4, w1);
+}
+
+static void
+Synth_Vertices (SynthState* state, int segNum)
+{
+    uint32_t block;
+
+    if (state->vtxBlocks.limit != 0 && state->params->vtxOverlap > 0.0 &&
+        Synth_RandUnit(state) < state->params->vtxOverlap)
+    {
+        // some of the block from any vertex on, as a model loading part of a shared vertex array does
+        block = *(uint32_t*)Vector_At(&state->vtxBlocks, Synth_Rand(state) % state->vtxBlocks.limit);
+        int count = block & 0xFF;
+        int first = Synth_Rand(state) % (count - 2);
+        int n = 3 + Synth_Rand(state) % (count - first - 2);
+        block = ((block >> 8) + first * SIZEOF_VTX) << 8 | n;
+    }
+    else if (state->vtxBlocks.limit != 0 && Synth_RandUnit(state) < state->params->vtxShare)
+    {
+        block = *(uint32_t*)Vector_At(&state->vtxBlocks, Synth_Rand(state) % state->vtxBlocks.limit);
+    }
+    else
+    {
+        int n = 3 + Synth_Rand(state) % (SYNTH_MAX_VTX - 2);
+        block = Synth_AddData(state, n * SIZEOF_VTX, 0) << 8 | n;
+        Vector_PushBack(&state->vtxBlocks, 1, &block);
+    }
+
+    int n = block & 0xFF;
+    Synth_Cmd(state, G_VTX << 24 | n << 12 | n << 1, SEGMENT_ADDR(segNum, block >> 8));
+    for (int i = 0; i + 2 < n; i += 3)
+        Synth_Cmd(state, G_TRI1 << 24 | (i * 2) << 16 | (i * 2 + 2) << 8 | (i * 2 + 4), 0);
+}
+
+static void
+Synth_Texture (SynthState* state, int segNum)
+{
+    SynthTexture tex;
+
+    if (state->textures.limit != 0 && Synth_RandUnit(state) < state->params->texShare)
+    {
+        tex = *(SynthTexture*)Vector_At(&state->textures, Synth_Rand(state) % state->textures.limit);
+    }
+    else
+    {
+        memset(&tex, 0, sizeof(tex));
+        tex.width = 16 << (Synth_Rand(state) % 3);
+        tex.height = 16 << (Synth_Rand(state) % 3);
+        if (Synth_RandUnit(state) < state->params->tlutMix)
+        {
+            tex.fmt = G_IM_FMT_CI;
+            tex.siz = G_IM_SIZ_8b;
+            tex.tlutCount = 256;
+            tex.tlutOffset = Synth_AddData(state, tex.tlutCount * 2, 0);
+        }
+        else
+        {
+            static const uint8_t sizes[] = { G_IM_SIZ_8b, G_IM_SIZ_16b, G_IM_SIZ_32b };
+            tex.siz = sizes[Synth_Rand(state) % ARRLEN(sizes)];
+            tex.fmt = (tex.siz == G_IM_SIZ_8b) ? G_IM_FMT_IA : G_IM_FMT_RGBA;
+        }
+        tex.offset = Synth_AddData(state, G_SIZ_BYTES(tex.siz) * tex.width * tex.height, 1);
+        Vector_PushBack(&state->textures, 1, &tex);
+    }
+
+    if (tex.tlutCount != 0)
+    {
+        // gsDPLoadTLUT_pal256
+        Synth_Cmd(state, G_SETTIMG << 24 | G_IM_FMT_RGBA << 21 | G_IM_SIZ_16b << 19, SEGMENT_ADDR(segNum, tex.tlutOffset));
+        Synth_Cmd(state, G_RDPTILESYNC << 24, 0);
+        Synth_Cmd(state, G_SETTILE << 24 | 0x100, 7 << 24);
+        Synth_Cmd(state, G_RDPLOADSYNC << 24, 0);
+        Synth_Cmd(state, G_LOADTLUT << 24, 7 << 24 | ((tex.tlutCount - 1) << 2) << 12);
+        Synth_Cmd(state, G_RDPPIPESYNC << 24, 0);
+    }
+
+    // gsDPLoadTextureBlock
+    Synth_Cmd(state, G_SETTIMG << 24 | tex.fmt << 21 | G_IM_SIZ_16b << 19, SEGMENT_ADDR(segNum, tex.offset));
+    Synth_Cmd(state, G_SETTILE << 24 | tex.fmt << 21 | G_IM_SIZ_16b << 19, 7 << 24);
+    Synth_Cmd(state, G_RDPLOADSYNC << 24, 0);
+    Synth_Cmd(state, G_LOADBLOCK << 24, 7 << 24 | (tex.width * tex.height - 1) << 12);
+    Synth_Cmd(state, G_RDPPIPESYNC << 24, 0);
+    Synth_Cmd(state, G_SETTILE << 24 | tex.fmt << 21 | tex.siz << 19 | 1 << 9, 0);
+    Synth_Cmd(state, G_SETTILESIZE << 24, ((tex.width - 1) << 2) << 12 | ((tex.height - 1) << 2));
+}
+
+static void
+Synth_Matrix (SynthState* state, int segNum)
+{
+    uint32_t offset;
+
+    // a handful of matrices shared by everything
+    if (state->mtxs.limit >= 8)
+    {
+        offset = *(uint32_t*)Vector_At(&state->mtxs, Synth_Rand(state) % state->mtxs.limit);
+    }
+    else
+    {
+        offset = Synth_AddData(state, SIZEOF_MTX, 0);
+        Vector_PushBack(&state->mtxs, 1, &offset);
+    }
+    Synth_Cmd(state, 0xDA380003, SEGMENT_ADDR(segNum, offset));
+}
+
+static void
+Synth_DisplayList (SynthState* state, int segNum, const uint32_t* callees, size_t numCallees)
+{
+    int numParts = 2 + Synth_Rand(state) % 6;
+
+    Synth_Cmd(state, G_RDPPIPESYNC << 24, 0);
+    Synth_Cmd(state, G_SETCOMBINE << 24 | 0x127E03, 0xFFFFF3F8);
+
+    for (int i = 0; i < numParts; i++)
+    {
+        switch (Synth_Rand(state) % 8)
+        {
+            case 0:
+            case 1:
+            case 2:
+                Synth_Vertices(state, segNum);
+                break;
+            case 3:
+            case 4:
+                Synth_Texture(state, segNum);
+                break;
+            case 5:
+                Synth_Matrix(state, segNum);
+                break;
+            case 6:
+                Synth_Cmd(state, G_SETPRIMCOLOR << 24, Synth_Rand(state));
+                break;
+            case 7:
+                Synth_Cmd(state, G_TEXRECT << 24 | (Synth_Rand(state) & 0xFFFFFF), Synth_Rand(state));
+                Synth_Cmd(state, G_RDPHALF_1 << 24, Synth_Rand(state));
+                Synth_Cmd(state, G_RDPHALF_2 << 24, Synth_Rand(state));
+                break;
+        }
+    }
+
+    for (size_t i = 0; i < numCallees; i++)
+    {
+        uint32_t pos = state->dls.limit;
+
+        Vector_PushBack(&state->dlFixups, 1, &pos);
+        Synth_Cmd(state, G_DL << 24 | G_DL_PUSH << 16, callees[i]);
+    }
+    Synth_Cmd(state, G_ENDDL << 24, 0);
+}
+
+void
+Synth_DefaultParams (SynthParams* params)
+{
+    params->numDisplayLists = 2000;
+    params->depth = 3;
+    params->vtxShare = 0.5;
+    params->vtxOverlap = 0.2;
+    params->texShare = 0.7;
+    params->tlutMix = 0.25;
+    params->seed = 1;
+}
+
+/*
+ * Generates a synthetic object into the empty object zobj and pushes the segmented addresses of its root display
+ * lists onto roots, a vector of segaddr_t.
+ */
+int
+Synth_Generate (ZObj* zobj, int segNum, const SynthParams* params, Vector* roots)
+{
+    SynthState state;
+    Vector levels;      // level of every display list
+    Vector offsets;     // offset of every display list in dls
+    int numLevels = params->depth + 1;
+    int ret = 0;
+
+    state.params = params;
+    state.rng = 0x9E3779B97F4A7C15ULL ^ params->seed;
+    Vector_New(&state.data, 1);
+    Vector_New(&state.dls, SIZEOF_GFX);
+    Vector_New(&state.dlFixups, sizeof(uint32_t));
+    Vector_New(&state.vtxBlocks, sizeof(uint32_t));
+    Vector_New(&state.textures, sizeof(SynthTexture));
+    Vector_New(&state.mtxs, sizeof(uint32_t));
+    Vector_New(&levels, sizeof(uint32_t));
+    Vector_New(&offsets, sizeof(uint32_t));
+
+    // the lowest level is generated first, so every callee exists before its callers
+    for (int level = 0; level < numLevels; level++)
+    {
+        size_t firstBelow = 0;
+        size_t numBelow = 0;
+
+        for (size_t i = 0; i < levels.limit; i++)
+        {
+            if (*(uint32_t*)Vector_At(&levels, i) == (uint32_t)level - 1)
+            {
+                if (numBelow++ == 0)
+                    firstBelow = i;
+            }
+        }
+
+        for (int i = level; i < params->numDisplayLists; i += numLevels)
+        {
+            uint32_t callees[3];
+            size_t numCallees = (numBelow == 0) ? 0 : 1 + Synth_Rand(&state) % ARRLEN(callees);
+            uint32_t offset = state.dls.limit * SIZEOF_GFX;
+            uint32_t lvl = level;
+
+            for (size_t j = 0; j < numCallees; j++)
+                callees[j] = *(uint32_t*)Vector_At(&offsets, firstBelow + Synth_Rand(&state) % numBelow);
+
+            Synth_DisplayList(&state, segNum, callees, numCallees);
+            Vector_PushBack(&levels, 1, &lvl);
+            Vector_PushBack(&offsets, 1, &offset);
+        }
+    }
+
+    // place the display lists after the data and resolve the calls between them
+    uint32_t dlStart = state.data.limit;
+    for (size_t i = 0; i < state.dlFixups.limit; i++)
+    {
+        uint8_t* cmd = Vector_At(&state.dls, *(uint32_t*)Vector_At(&state.dlFixups, i));
+        WRITE_32_BE(cmd, 4, SEGMENT_ADDR(segNum, dlStart + READ_32_BE(cmd, 4)));
+    }
+    for (size_t i = 0; i < levels.limit; i++)
+    {
+        if (*(uint32_t*)Vector_At(&levels, i) == (uint32_t)numLevels - 1)
+        {
+            segaddr_t root = SEGMENT_ADDR(segNum, dlStart + *(uint32_t*)Vector_At(&offsets, i));
+            Vector_PushBack(roots, 1, &root);
+        }
+    }
+
+    size_t dlSize = state.dls.limit * SIZEOF_GFX;
+    uint8_t* buffer = ZObj_Alloc(zobj, dlStart + dlSize);
+    if (buffer == NULL)
+    {
+        ret = -1;
+    }
+    else
+    {
+        if (dlStart != 0)
+            memcpy(buffer, state.data.start, dlStart);
+        memcpy(buffer + dlStart, state.dls.start, dlSize);
+    }
+
+    Vector_Destroy(&state.data);
+    Vector_Destroy(&state.dls);
+    Vector_Destroy(&state.dlFixups);
+    Vector_Destroy(&state.vtxBlocks);
+    Vector_Destroy(&state.textures);
+    Vector_Destroy(&state.mtxs);
+    Vector_Destroy(&levels);
+    Vector_Destroy(&offsets);
+    return ret;
+}
@@ -0,0 +1,29 @@
+#ifndef SYNTH_H_
+#define SYNTH_H_
+
+#include <stddef.h>
+
+#include "vector.h"
+#include "zobj.h"
+
+/*
+ * Shape of a synthetic object. Display lists are arranged in depth + 1 levels, each list calls lists from the level
+ * below it and the lists of the top level are the roots.
+ */
+typedef struct SynthParams {
+    int numDisplayLists;
+    int depth;
+    double vtxShare;    // chance that a vertex load reuses an earlier vertex block instead of a new one
+    double vtxOverlap;  // chance that a vertex load reads a window into an earlier vertex block, overlapping its loads
+    double texShare;    // chance that a texture load reuses an earlier texture instead of a new one
+    double tlutMix;     // fraction of texture loads that are palettised, with a gsDPLoadTLUT before the texture
+    unsigned seed;
+} SynthParams;
+
+void
+Synth_DefaultParams (SynthParams* params);
+
+int
+Synth_Generate (ZObj* zobj, int segNum, const SynthParams* params, Vector* roots);
+
+#endif
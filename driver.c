@@ -0,0 +1,921 @@
+/*
+ *  Manifest driver for zobjcopy, copies display lists for many objects in parallel
+ *
+ *  Each non-empty manifest line not starting with # describes one job:
+ *      <source.zobj> <segment> <output.zobj> <root> [<root> ...]
+ *  The roots are segmented addresses in hex of the display lists to copy from the source, which is assigned the
+ *  given segment number. The output object uses the same segment. A root written as skel:<addr>, lodskel:<addr>,
+ *  flexskel:<addr> or flexlodskel:<addr> is a skeleton of that type instead, copied with its limbs and their display
+ *  lists. Skeletons cannot be copied with --incremental or --layout.
+ *
+ *  Next to every output written, <output.zobj>.roots lists the address of each root in the output, one
+ *  "<root> <new root>" line per root in manifest order.
+ *
+ *  With --stats <file.json>, the copy counters of every job and their totals are written to the given file, along
+ *  with the new address of every root. This needs the library built with DL_STATS defined ("make STATS=1").
+ *
+ *  With --incremental, each output is copied into instead of replaced. The display lists copied by earlier runs are
+ *  remembered in <output.zobj>.idx together with the duplicate index of the output, and are only copied again if they
+ *  or anything they use changed in the source. Incremental jobs copy through a RefGraph, which keeps no copy counters,
+ *  so --incremental cannot be used with --stats.
+ *  --coalesce-vtx, only with --incremental, copies vertices that display lists load from overlapping parts of one
+ *  array as a single run instead of once per load.
+ *
+ *  With --shared <report.json>, the vertices, textures and TLUTs copied into every output are recorded in a DataStore
+ *  and those found in more than one output are reported, failed jobs included. --shared-object <file.zobj> also writes
+ *  them out as one object for segment 4, the segment of gameplay_keep, with their addresses listed in the report.
+ *
+ *  With --dedup-dl identical, display lists that come out identical to one already in the output are not added again.
+ *  With --dedup-dl tails, display lists also end by branching into a matching tail of one already in the output.
+ *
+ *  With --layout, outputs are written with textures and TLUTs first, then vertices, other data and display lists, each
+ *  in the order the roots first use them.
+ *
+ *  With --rom <rom.z64>, sources are read from the ROM image instead of files, mapped once for all jobs. A source is
+ *  then either the index of a file in the ROM's file table (dmadata), or "<offset>:<size>" of the object in the ROM.
+ *
+ *  With --segment <segment>:<source>, given once per segment, display lists and data that jobs reach in that segment
+ *  are copied into their outputs as well, instead of being left pointing into it. The source is opened once for all
+ *  jobs, from the ROM with --rom. A job's own source takes the place of any given for its segment.
+ *
+ *  With --strip, each source is not copied from but cut down in place to what its roots reach and written out as the
+ *  output, see Strip_Compact. It can be combined with --layout and --yaz0 only, and needs display list roots.
+ *
+ *  With --relocs, every pointer patched in an output is recorded in a relocation table written next to it as
+ *  <output.zobj>.rel, from which the output can be moved to another segment or load address with Reloc_Rebase. It
+ *  cannot be used with --incremental, --layout or --strip, which move pointers without recording them.
+ *
+ *  With --yaz0, outputs (and the shared object) are written Yaz0 compressed. Compressed sources, and compressed outputs
+ *  copied into by --incremental, are recognized and decompressed on their own.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "datastore.h"
+#include "displaylist.h"
+#include "json.h"
+#include "layout.h"
+#include "refgraph.h"
+#include "reloc.h"
+#include "rom.h"
+#include "skeleton.h"
+#include "strip.h"
+#include "workpool.h"
+#include "driver.h"
+
+typedef struct DriverJob {
+    char* source;
+    int segment;
+    char* output;
+    segaddr_t* roots;
+    segaddr_t* newRoots;    // address of each root in the output, -1 for roots that failed
+    int* rootTypes; // SkeletonType of each root or -1 for display lists, NULL if every root is a display list
+    size_t numRoots;
+    int numFailed;
+    char* errors;   // messages for the roots that failed, NULL if none did
+    DLStats stats;
+} DriverJob;
+
+typedef struct Manifest {
+    DriverJob* jobs;
+    size_t numJobs;
+    size_t capacity;
+    bool incremental;
+    bool coalesceVtx;   // copy overlapping vertex loads as one run, for --incremental
+    DataStore* store;   // NULL unless looking for shared data
+    DLDedupMode dedupMode;
+    bool layout;
+    bool strip;
+    bool relocs;        // write a relocation table next to every output
+    ZObjCompression compression;    // how to write outputs, outputs read back by --incremental keep theirs otherwise
+    const Rom* rom;     // ROM that sources are read from, NULL if they are files
+    // sources of other segments shared by every job, NULL for segments with none
+    ZObj* segments[NUM_SEGMENTS];
+} Manifest;
+
+static void
+Driver_Usage (const char* prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-j <threads>] [--stats <file.json>] [--incremental [--coalesce-vtx]]\n"
+            "          [--shared <report.json> [--shared-object <file.zobj>]] [--dedup-dl identical|tails]\n"
+            "          [--layout] [--yaz0] [--rom <rom.z64>] [--segment <segment>:<source> ...] [--strip]\n"
+            "          [--relocs] <manifest>\n"
+            "Manifest lines: <source.zobj> <segment> <output.zobj> <root> [<root> ...]\n"
+            "With --rom, sources are <file index> or <offset>:<size> in the ROM\n", prog);
+}
+
+static const char* driver_skeleton_prefixes[SKELETON_MAX] = {
+    [SKELETON_STANDARD] = "skel:",
+    [SKELETON_LOD]      = "lodskel:",
+    [SKELETON_FLEX]     = "flexskel:",
+    [SKELETON_FLEX_LOD] = "flexlodskel:",
+};
+
+/*
+ * Strips a skeleton type prefix from a root, returns the type or -1 if the root is a display list
+ */
+static int
+Driver_ParseRootType (char** tok)
+{
+    for (int type = 0; type < SKELETON_MAX; type++)
+    {
+        size_t len = strlen(driver_skeleton_prefixes[type]);
+
+        if (strncmp(*tok, driver_skeleton_prefixes[type], len) == 0)
+        {
+            *tok += len;
+            return type;
+        }
+    }
+    return -1;
+}
+
+static int
+Driver_ParseLine (DriverJob* job, char* line, const char* path, int lineNum)
+{
+    char* save;
+    char* tok;
+    char* endp;
+    size_t rootsCapacity = 8;
+
+    memset(job, 0, sizeof(*job));
+
+    job->source = strtok_r(line, " \t\r\n", &save);
+    tok = strtok_r(NULL, " \t\r\n", &save);
+    job->output = strtok_r(NULL, " \t\r\n", &save);
+    if (job->source == NULL || tok == NULL || job->output == NULL)
+        goto bad;
+
+    // segments are decimal, a leading 0 does not make them octal
+    job->segment = strtol(tok, &endp, 10);
+    if (*endp != '\0' || endp == tok || job->segment < 0 || job->segment >= NUM_SEGMENTS)
+        goto bad;
+
+    job->roots = malloc(rootsCapacity * sizeof(segaddr_t));
+    if (job->roots == NULL)
+        goto nomem;
+    while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+    {
+        int type;
+
+        if (job->numRoots == rootsCapacity)
+        {
+            segaddr_t* roots = realloc(job->roots, rootsCapacity * 2 * sizeof(segaddr_t));
+
+            if (roots == NULL)
+                goto nomem;
+            job->roots = roots;
+            if (job->rootTypes != NULL)
+            {
+                int* rootTypes = realloc(job->rootTypes, rootsCapacity * 2 * sizeof(int));
+
+                if (rootTypes == NULL)
+                    goto nomem;
+                job->rootTypes = rootTypes;
+            }
+            rootsCapacity *= 2;
+        }
+
+        type = Driver_ParseRootType(&tok);
+        if (type >= 0 && job->rootTypes == NULL)
+        {
+            job->rootTypes = malloc(rootsCapacity * sizeof(int));
+            if (job->rootTypes == NULL)
+                goto nomem;
+            for (size_t i = 0; i < job->numRoots; i++)
+                job->rootTypes[i] = -1;
+        }
+        if (job->rootTypes != NULL)
+            job->rootTypes[job->numRoots] = type;
+
+        job->roots[job->numRoots++] = strtoul(tok, &endp, 16);
+        if (*endp != '\0' || endp == tok)
+            goto bad;
+    }
+    if (job->numRoots == 0)
+        goto bad;
+
+    job->source = strdup(job->source);
+    job->output = strdup(job->output);
+    if (job->source == NULL || job->output == NULL)
+    {
+        free(job->source);
+        free(job->output);
+        goto nomem;
+    }
+    return 0;
+bad:
+    fprintf(stderr, "error: %s:%d: malformed manifest line\n", path, lineNum);
+    free(job->roots);
+    free(job->rootTypes);
+    return -1;
+nomem:
+    fprintf(stderr, "error: %s:%d: out of memory reading manifest line\n", path, lineNum);
+    free(job->roots);
+    free(job->rootTypes);
+    return -1;
+}
+
+static int
+Driver_ReadManifest (Manifest* manifest, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    int lineNum = 0;
+    int ret = 0;
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "error: failed to open manifest '%s'\n", path);
+        return -1;
+    }
+
+    manifest->jobs = NULL;
+    manifest->numJobs = manifest->capacity = 0;
+
+    // lines can be any length, a job may have thousands of roots
+    while (getline(&line, &lineCapacity, file) != -1)
+    {
+        char* p = line + strspn(line, " \t");
+
+        lineNum++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+            continue;
+
+        if (manifest->numJobs == manifest->capacity)
+        {
+            size_t capacity = (manifest->capacity == 0) ? 16 : manifest->capacity * 2;
+            DriverJob* jobs = realloc(manifest->jobs, capacity * sizeof(DriverJob));
+
+            if (jobs == NULL)
+            {
+                fprintf(stderr, "error: %s:%d: out of memory reading manifest\n", path, lineNum);
+                ret = -1;
+                break;
+            }
+            manifest->jobs = jobs;
+            manifest->capacity = capacity;
+        }
+        if (Driver_ParseLine(&manifest->jobs[manifest->numJobs], p, path, lineNum) != 0)
+        {
+            ret = -1;
+            break;
+        }
+        manifest->numJobs++;
+    }
+    free(line);
+    fclose(file);
+    return ret;
+}
+
+/*
+ * Path of a file that goes next to an output, the output's path with ext appended. Returns NULL if out of memory.
+ */
+static char*
+Driver_SidecarPath (const char* output, const char* ext)
+{
+    char* path = malloc(strlen(output) + strlen(ext) + 1);
+
+    if (path != NULL)
+        sprintf(path, "%s%s", output, ext);
+    return path;
+}
+
+static int
+Driver_WriteOutput (const Manifest* manifest, ZObj* obj, const char* path)
+{
+    // jobs already run in parallel, so each compresses on its own thread
+    if (manifest->compression != ZOBJ_COMPRESSION_NONE)
+        obj->compression = manifest->compression;
+    return ZObj_Write(obj, path);
+}
+
+/*
+ * Writes a job's output, failing every root of the job if it cannot be written rather than stopping the other jobs
+ */
+static int
+Driver_WriteJobOutput (DriverJob* job, const Manifest* manifest, ZObj* obj)
+{
+    if (Driver_WriteOutput(manifest, obj, job->output) == 0)
+        return 0;
+
+    job->numFailed = job->numRoots;
+    job->errors = strdup(DisplayList_ErrMsg());
+    return -1;
+}
+
+/*
+ * Writes a copied output with its contents grouped by type, see Layout_Optimize
+ */
+static void
+Driver_WriteLaidOut (DriverJob* job, const Manifest* manifest, ZObj* dst, segaddr_t* newRoots)
+{
+    segaddr_t* laidOutRoots = malloc(job->numRoots * sizeof(segaddr_t));
+    ZObj out;
+
+    ZObj_New(&out, job->segment);
+    if (laidOutRoots == NULL || Layout_Optimize(dst, newRoots, job->numRoots, &out, laidOutRoots) != 0)
+    {
+        job->numFailed = job->numRoots;
+        job->errors = strdup((laidOutRoots == NULL) ? "Could not allocate memory for the laid out roots\n"
+                                                    : DisplayList_ErrMsg());
+    }
+    else if (Driver_WriteJobOutput(job, manifest, &out) == 0)
+    {
+        memcpy(newRoots, laidOutRoots, job->numRoots * sizeof(segaddr_t));
+    }
+    ZObj_Free(&out);
+    free(laidOutRoots);
+}
+
+/*
+ * Copies the i-th root of a job that has skeletons among its roots
+ */
+static int
+Driver_CopyRoot (DisplayListSession* session, size_t i, segaddr_t segAddr, void* arg, segaddr_t* newSegAddr)
+{
+    const DriverJob* job = arg;
+
+    if (job->rootTypes[i] < 0)
+        return DisplayList_SessionCopy(session, segAddr, newSegAddr);
+    return Skeleton_Copy(session, segAddr, job->rootTypes[i], newSegAddr);
+}
+
+/*
+ * Copies a job into a new output
+ */
+static void
+Driver_Copy (DriverJob* job, int jobNum, const Manifest* manifest, ZObj* src, ZObj* dst, segaddr_t* newRoots)
+{
+    DisplayListSession session;
+    RelocTable relocs;
+
+    // outputs grow in chunks, so large merged objects are never moved while copying
+    ZObj_NewChunked(dst, job->segment, 0);
+
+    DisplayList_SessionNew(&session, src, dst);
+    for (int i = 0; i < NUM_SEGMENTS; i++)
+    {
+        if (manifest->segments[i] != NULL && i != job->segment)
+            DisplayList_SessionAddSegment(&session, manifest->segments[i]);
+    }
+    session.store = manifest->store;
+    session.storeObject = jobNum;
+    session.dedup.mode = manifest->dedupMode;
+    Reloc_New(&relocs, SEGMENT_ADDR(job->segment, 0));
+    if (manifest->relocs)
+        session.relocs = &relocs;
+    if (job->rootTypes != NULL)
+        job->numFailed = DisplayList_SessionCopyEach(&session, job->roots, job->numRoots, "Root", Driver_CopyRoot, job,
+                                                     newRoots);
+    else
+        job->numFailed = DisplayList_SessionCopyBatch(&session, job->roots, job->numRoots, newRoots);
+    if (DisplayList_SessionStats(&session) != NULL)
+        job->stats = *DisplayList_SessionStats(&session);
+    DisplayList_SessionFree(&session);
+
+    if (job->numFailed != 0)
+        job->errors = strdup(DisplayList_ErrMsg());
+    else if (manifest->layout)
+        Driver_WriteLaidOut(job, manifest, dst, newRoots);
+    else
+        Driver_WriteJobOutput(job, manifest, dst);
+
+    if (job->numFailed == 0 && manifest->relocs)
+    {
+        char* relocPath = Driver_SidecarPath(job->output, ".rel");
+
+        if (relocPath == NULL || Reloc_Write(&relocs, relocPath) != 0)
+            fprintf(stderr, "warning: failed to write '%s.rel'\n", job->output);
+        free(relocPath);
+    }
+    Reloc_Free(&relocs);
+}
+
+/*
+ * Strips a job's source down to what its roots reach instead of copying it
+ */
+static void
+Driver_Strip (DriverJob* job, const Manifest* manifest, ZObj* obj, segaddr_t* newRoots)
+{
+    int ret = ZObj_Read(obj, job->source, job->segment);
+
+    if (ret > 0)
+        DisplayList_ErrMsgSet("Source '%s' is empty\n", job->source);
+    if (ret != 0 || Strip_Compact(obj, job->roots, job->numRoots, newRoots) != 0)
+    {
+        job->numFailed = job->numRoots;
+        job->errors = strdup(DisplayList_ErrMsg());
+    }
+    else if (manifest->layout)
+    {
+        Driver_WriteLaidOut(job, manifest, obj, newRoots);
+    }
+    else
+    {
+        Driver_WriteJobOutput(job, manifest, obj);
+    }
+}
+
+/*
+ * Copies a job into its existing output if there is one, reusing what earlier runs copied there
+ */
+static void
+Driver_CopyIncremental (DriverJob* job, const Manifest* manifest, ZObj* src, ZObj* dst, segaddr_t* newRoots)
+{
+    char* memoPath = Driver_SidecarPath(job->output, ".idx");
+    RefGraph graph;
+    RefMemo memo;
+
+    if (memoPath == NULL)
+    {
+        job->numFailed = job->numRoots;
+        job->errors = strdup("Could not allocate memory for the path of the memo\n");
+        return;
+    }
+
+    // a missing or stale memo leaves it empty, so everything is copied as if into a new output
+    RefMemo_New(&memo);
+    if (access(job->output, R_OK) == 0)
+    {
+        if (ZObj_Read(dst, job->output, job->segment) != 0)
+        {
+            job->numFailed = job->numRoots;
+            job->errors = strdup(DisplayList_ErrMsg());
+            RefMemo_Free(&memo);
+            free(memoPath);
+            return;
+        }
+        RefMemo_Read(&memo, dst, memoPath);
+    }
+    else
+    {
+        ZObj_NewChunked(dst, job->segment, 0);
+    }
+
+    RefGraph_New(&graph, src);
+    graph.dedupMode = manifest->dedupMode;
+    graph.coalesceVtx = manifest->coalesceVtx;
+    job->numFailed = RefGraph_CopyIncremental(&graph, job->roots, job->numRoots, dst, newRoots, &memo);
+    RefGraph_Free(&graph);
+
+    if (job->numFailed != 0)
+    {
+        job->errors = strdup(DisplayList_ErrMsg());
+    }
+    else if (Driver_WriteJobOutput(job, manifest, dst) == 0)
+    {
+        if (RefMemo_Write(&memo, dst, memoPath) != 0)
+            fprintf(stderr, "warning: failed to write '%s', the next run copies everything again\n", memoPath);
+    }
+
+    RefMemo_Free(&memo);
+    free(memoPath);
+}
+
+/*
+ * Parses a source in a ROM, either a file index or an offset and size
+ */
+static int
+Driver_ParseRomSource (const char* source, bool* isFile, size_t* indexOrOffset, size_t* size)
+{
+    char* endp;
+
+    *indexOrOffset = strtoul(source, &endp, 0);
+    *isFile = (*endp == '\0');
+    *size = 0;
+    if (*isFile)
+        return (endp == source) ? -1 : 0;
+
+    if (*endp != ':' || endp == source)
+        return -1;
+    source = endp + 1;
+    *size = strtoul(source, &endp, 0);
+    return (*endp != '\0' || endp == source) ? -1 : 0;
+}
+
+static int
+Driver_OpenSource (const Manifest* manifest, const char* source, int segment, ZObj* src)
+{
+    bool isFile;
+    size_t indexOrOffset;
+    size_t size;
+
+    if (manifest->rom == NULL)
+    {
+        int ret = ZObj_Map(src, source, segment);
+
+        if (ret > 0)
+        {
+            ZObj_Free(src);
+            return DisplayList_ErrMsgSet("Source '%s' is empty\n", source);
+        }
+        return ret;
+    }
+
+    // already checked before any job started
+    Driver_ParseRomSource(source, &isFile, &indexOrOffset, &size);
+    if (isFile)
+        return Rom_ViewFile(manifest->rom, src, indexOrOffset, segment);
+    return Rom_View(manifest->rom, src, indexOrOffset, size, segment);
+}
+
+/*
+ * Checks that a source in a ROM is written correctly before any thread starts. Sources that cannot be opened only fail
+ * their own job.
+ */
+static int
+Driver_CheckRomSource (const char* source)
+{
+    bool isFile;
+    size_t indexOrOffset;
+    size_t size;
+
+    if (Driver_ParseRomSource(source, &isFile, &indexOrOffset, &size) != 0)
+    {
+        fprintf(stderr, "error: malformed ROM source '%s'\n", source);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Lists where every root of a job ended up in its output next to it as <output>.roots, one "<root> <new root>" line
+ * per root in manifest order
+ */
+static void
+Driver_WriteRoots (DriverJob* job)
+{
+    char* path = Driver_SidecarPath(job->output, ".roots");
+    FILE* file = (path == NULL) ? NULL : fopen(path, "w");
+    bool failed = (file == NULL);
+
+    for (size_t i = 0; file != NULL && i < job->numRoots; i++)
+        failed |= (fprintf(file, "%08X %08X\n", job->roots[i], job->newRoots[i]) < 0);
+    if (file != NULL && fclose(file) != 0)
+        failed = true;
+    if (failed)
+        fprintf(stderr, "warning: failed to write '%s.roots'\n", job->output);
+    free(path);
+}
+
+/*
+ * Runs on a pool thread. Every job has its own pair of objects and the library keeps its error message per thread,
+ * so jobs share nothing but the manifest entries they own and the sources of other segments, which are only read.
+ */
+static void
+Driver_RunJob (size_t jobNum, int worker, void* arg)
+{
+    Manifest* manifest = arg;
+    DriverJob* job = &manifest->jobs[jobNum];
+    ZObj src;
+    ZObj dst;
+
+    job->newRoots = malloc(job->numRoots * sizeof(segaddr_t));
+    if (job->newRoots == NULL)
+    {
+        job->numFailed = job->numRoots;
+        job->errors = strdup("Could not allocate memory for the copied roots\n");
+        return;
+    }
+
+    if (manifest->strip)
+    {
+        Driver_Strip(job, manifest, &src, job->newRoots);
+        ZObj_Free(&src);
+    }
+    else if (Driver_OpenSource(manifest, job->source, job->segment, &src) != 0)
+    {
+        job->numFailed = job->numRoots;
+        job->errors = strdup(DisplayList_ErrMsg());
+        return;
+    }
+    else
+    {
+        if (manifest->incremental)
+            Driver_CopyIncremental(job, manifest, &src, &dst, job->newRoots);
+        else
+            Driver_Copy(job, jobNum, manifest, &src, &dst, job->newRoots);
+
+        ZObj_Free(&src);
+        ZObj_Free(&dst);
+    }
+
+    if (job->numFailed == 0)
+        Driver_WriteRoots(job);
+}
+
+static int
+Driver_WriteStats (const Manifest* manifest, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    DLStats total;
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "error: failed to open '%s' for writing\n", path);
+        return -1;
+    }
+
+    DLStats_Clear(&total);
+    fprintf(file, "{\n  \"jobs\": [\n");
+    for (size_t i = 0; i < manifest->numJobs; i++)
+    {
+        const DriverJob* job = &manifest->jobs[i];
+
+        fprintf(file, "    {\n      \"source\": ");
+        Json_WriteString(file, job->source);
+        fprintf(file, ",\n      \"output\": ");
+        Json_WriteString(file, job->output);
+        fprintf(file, ",\n      \"roots\": %lu,\n      \"failed\": %d,\n      \"newRoots\": [", job->numRoots,
+                job->numFailed);
+        // pairs of each root and its address in the output, which is FFFFFFFF for roots that failed
+        for (size_t j = 0; j < job->numRoots; j++)
+        {
+            fprintf(file, "%s[\"%08X\", \"%08X\"]", (j == 0) ? "" : ", ", job->roots[j],
+                    (job->newRoots == NULL) ? (segaddr_t)-1 : job->newRoots[j]);
+        }
+        fprintf(file, "],\n      \"stats\": ");
+        DLStats_WriteJson(&job->stats, file, 6);
+        fprintf(file, "\n    }%s\n", (i == manifest->numJobs - 1) ? "" : ",");
+        DLStats_Add(&total, &job->stats);
+    }
+    fprintf(file, "  ],\n  \"total\": ");
+    DLStats_WriteJson(&total, file, 2);
+    fprintf(file, "\n}\n");
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Writes out the data found in more than one output, then the report listing it
+ */
+static int
+Driver_WriteShared (const Manifest* manifest, DataStore* store, const char* path, const char* objectPath)
+{
+    FILE* file;
+
+    if (objectPath != NULL)
+    {
+        ZObj shared;
+
+        ZObj_New(&shared, 4);
+        if (DataStore_EmitShared(store, &shared, 2) < 0)
+        {
+            fprintf(stderr, "error: %s", DisplayList_ErrMsg());
+            ZObj_Free(&shared);
+            return -1;
+        }
+        if (Driver_WriteOutput(manifest, &shared, objectPath) != 0)
+        {
+            fprintf(stderr, "error: %s", DisplayList_ErrMsg());
+            ZObj_Free(&shared);
+            return -1;
+        }
+        ZObj_Free(&shared);
+    }
+
+    file = fopen(path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "error: failed to open '%s' for writing\n", path);
+        return -1;
+    }
+    if (DataStore_WriteReport(store, file, 2) != 0)
+    {
+        fprintf(stderr, "error: %s", DisplayList_ErrMsg());
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+int
+Driver_Main (int argc, const char** argv)
+{
+    Manifest manifest;
+    const char* manifestPath = NULL;
+    const char* statsPath = NULL;
+    int numWorkers = WorkPool_DefaultWorkers();
+    int numFailedJobs = 0;
+    bool incremental = false;
+    bool coalesceVtx = false;
+    const char* sharedPath = NULL;
+    const char* sharedObjectPath = NULL;
+    DataStore store;
+    DLDedupMode dedupMode = DL_DEDUP_NONE;
+    bool layout = false;
+    bool strip = false;
+    bool relocs = false;
+    ZObjCompression compression = ZOBJ_COMPRESSION_NONE;
+    const char* romPath = NULL;
+    Rom rom;
+    const char* segmentSources[NUM_SEGMENTS] = { NULL };
+    ZObj segments[NUM_SEGMENTS];
+    bool segmentsValid = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            numWorkers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+            statsPath = argv[++i];
+        else if (strcmp(argv[i], "--incremental") == 0)
+            incremental = true;
+        else if (strcmp(argv[i], "--coalesce-vtx") == 0)
+            coalesceVtx = true;
+        else if (strcmp(argv[i], "--layout") == 0)
+            layout = true;
+        else if (strcmp(argv[i], "--strip") == 0)
+            strip = true;
+        else if (strcmp(argv[i], "--relocs") == 0)
+            relocs = true;
+        else if (strcmp(argv[i], "--yaz0") == 0)
+            compression = ZOBJ_COMPRESSION_YAZ0;
+        else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc)
+            romPath = argv[++i];
+        else if (strcmp(argv[i], "--segment") == 0 && i + 1 < argc)
+        {
+            char* endp;
+            long segment = strtol(argv[++i], &endp, 10);
+
+            if (*endp != ':' || endp == argv[i] || segment < 0 || segment >= NUM_SEGMENTS)
+                segmentsValid = false;
+            else
+                segmentSources[segment] = endp + 1;
+        }
+        else if (strcmp(argv[i], "--shared") == 0 && i + 1 < argc)
+            sharedPath = argv[++i];
+        else if (strcmp(argv[i], "--shared-object") == 0 && i + 1 < argc)
+            sharedObjectPath = argv[++i];
+        else if (strcmp(argv[i], "--dedup-dl") == 0 && i + 1 < argc && strcmp(argv[i + 1], "identical") == 0)
+            dedupMode = DL_DEDUP_IDENTICAL, i++;
+        else if (strcmp(argv[i], "--dedup-dl") == 0 && i + 1 < argc && strcmp(argv[i + 1], "tails") == 0)
+            dedupMode = DL_DEDUP_TAILS, i++;
+        else if (manifestPath == NULL && argv[i][0] != '-')
+            manifestPath = argv[i];
+        else
+        {
+            Driver_Usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (manifestPath == NULL || numWorkers < 1 || (sharedObjectPath != NULL && sharedPath == NULL) || !segmentsValid ||
+        (coalesceVtx && !incremental))
+    {
+        Driver_Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (statsPath != NULL && !DL_STATS_ENABLED)
+    {
+        fprintf(stderr, "error: --stats needs zobjcopy built with DL_STATS, rebuild with \"make clean && make STATS=1\"\n");
+        return EXIT_FAILURE;
+    }
+
+    if (statsPath != NULL && incremental)
+    {
+        fprintf(stderr, "error: --stats cannot be used with --incremental, which copies without counting\n");
+        return EXIT_FAILURE;
+    }
+
+    bool anySegments = false;
+    for (int i = 0; i < NUM_SEGMENTS; i++)
+        anySegments |= (segmentSources[i] != NULL);
+
+    if ((sharedPath != NULL || layout || anySegments) && incremental)
+    {
+        fprintf(stderr, "error: --shared, --layout and --segment cannot be used with --incremental\n");
+        return EXIT_FAILURE;
+    }
+
+    if (strip && (incremental || sharedPath != NULL || anySegments || romPath != NULL || dedupMode != DL_DEDUP_NONE))
+    {
+        fprintf(stderr, "error: --strip can only be combined with --layout and --yaz0\n");
+        return EXIT_FAILURE;
+    }
+
+    if (relocs && (incremental || layout || strip))
+    {
+        fprintf(stderr, "error: --relocs cannot be used with --incremental, --layout or --strip\n");
+        return EXIT_FAILURE;
+    }
+
+    if (Driver_ReadManifest(&manifest, manifestPath) != 0)
+        return EXIT_FAILURE;
+
+    for (size_t i = 0; i < manifest.numJobs; i++)
+    {
+        if (manifest.jobs[i].rootTypes != NULL && (incremental || layout || strip))
+        {
+            fprintf(stderr, "error: skeletons cannot be copied with --incremental, --layout or --strip\n");
+            return EXIT_FAILURE;
+        }
+    }
+    manifest.incremental = incremental;
+    manifest.coalesceVtx = coalesceVtx;
+    manifest.store = NULL;
+    manifest.dedupMode = dedupMode;
+    manifest.layout = layout;
+    manifest.strip = strip;
+    manifest.relocs = relocs;
+    manifest.compression = compression;
+    manifest.rom = NULL;
+    memset(manifest.segments, 0, sizeof(manifest.segments));
+
+    // jobs record their data under their number in the manifest
+    if (sharedPath != NULL)
+    {
+        DataStore_New(&store);
+        manifest.store = &store;
+        for (size_t i = 0; i < manifest.numJobs; i++)
+        {
+            if (DataStore_AddObject(&store, manifest.jobs[i].output) < 0)
+            {
+                fprintf(stderr, "error: %s", DisplayList_ErrMsg());
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < manifest.numJobs && romPath != NULL; i++)
+    {
+        if (Driver_CheckRomSource(manifest.jobs[i].source) != 0)
+            return EXIT_FAILURE;
+    }
+    for (int i = 0; i < NUM_SEGMENTS && romPath != NULL; i++)
+    {
+        if (segmentSources[i] != NULL && Driver_CheckRomSource(segmentSources[i]) != 0)
+            return EXIT_FAILURE;
+    }
+
+    if (romPath != NULL)
+    {
+        if (Rom_Open(&rom, romPath) != 0)
+        {
+            fprintf(stderr, "error: %s", DisplayList_ErrMsg());
+            return EXIT_FAILURE;
+        }
+        manifest.rom = &rom;
+    }
+
+    for (int i = 0; i < NUM_SEGMENTS; i++)
+    {
+        if (segmentSources[i] == NULL)
+            continue;
+        if (Driver_OpenSource(&manifest, segmentSources[i], i, &segments[i]) != 0)
+        {
+            fprintf(stderr, "error: %s", DisplayList_ErrMsg());
+            return EXIT_FAILURE;
+        }
+        manifest.segments[i] = &segments[i];
+    }
+
+    if (WorkPool_Run(manifest.numJobs, numWorkers, Driver_RunJob, &manifest) != 0)
+    {
+        fprintf(stderr, "error: could not start worker threads\n");
+        return EXIT_FAILURE;
+    }
+
+    // job stats are zeroed by Driver_ParseLine, so failed jobs still report whatever they copied
+    bool statsFailed = (statsPath != NULL && Driver_WriteStats(&manifest, statsPath) != 0);
+    bool sharedFailed = (sharedPath != NULL && Driver_WriteShared(&manifest, &store, sharedPath, sharedObjectPath) != 0);
+
+    for (size_t i = 0; i < manifest.numJobs; i++)
+    {
+        DriverJob* job = &manifest.jobs[i];
+
+        if (job->numFailed != 0)
+        {
+            fprintf(stderr, "%s: %d of %lu roots failed, not written\n%s", job->source, job->numFailed,
+                    job->numRoots, job->errors);
+            numFailedJobs++;
+        }
+        free(job->source);
+        free(job->output);
+        free(job->roots);
+        free(job->newRoots);
+        free(job->rootTypes);
+        free(job->errors);
+    }
+    free(manifest.jobs);
+    if (manifest.store != NULL)
+        DataStore_Free(manifest.store);
+    for (int i = 0; i < NUM_SEGMENTS; i++)
+    {
+        if (manifest.segments[i] != NULL)
+            ZObj_Free(manifest.segments[i]);
+    }
+    if (manifest.rom != NULL)
+        Rom_Close(&rom);
+
+    printf("%lu jobs, %d failed\n", manifest.numJobs, numFailedJobs);
+    return (numFailedJobs == 0 && !statsFailed && !sharedFailed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
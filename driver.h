@@ -0,0 +1,7 @@
+#ifndef DRIVER_H_
+#define DRIVER_H_
+
+int
+Driver_Main (int argc, const char** argv);
+
+#endif
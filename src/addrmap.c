@@ -0,0 +1,119 @@
+/*
+ *  Hash map from segmented address to segmented address, for looking up what has been copied where
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addrmap.h"
+
+#define ADDRMAP_EMPTY ((segaddr_t)-1)
+#define ADDRMAP_MIN_CAPACITY 64
+
+static inline size_t
+AddrMap_Slot (size_t capacity, segaddr_t key)
+{
+    return (uint32_t)(key * 0x9E3779B1U) & (capacity - 1);
+}
+
+static int
+AddrMap_Grow (AddrMap* map, size_t newCapacity)
+{
+    segaddr_t* keys = malloc(newCapacity * sizeof(segaddr_t));
+    segaddr_t* values = malloc(newCapacity * sizeof(segaddr_t));
+
+    if (keys == NULL || values == NULL)
+    {
+        free(keys);
+        free(values);
+        return -1;
+    }
+    memset(keys, 0xFF, newCapacity * sizeof(segaddr_t));
+
+    for (size_t i = 0; i < map->capacity; i++)
+    {
+        if (map->keys[i] == ADDRMAP_EMPTY)
+            continue;
+
+        size_t slot = AddrMap_Slot(newCapacity, map->keys[i]);
+        while (keys[slot] != ADDRMAP_EMPTY)
+            slot = (slot + 1) & (newCapacity - 1);
+        keys[slot] = map->keys[i];
+        values[slot] = map->values[i];
+    }
+
+    free(map->keys);
+    free(map->values);
+    map->keys = keys;
+    map->values = values;
+    map->capacity = newCapacity;
+    return 0;
+}
+
+void
+AddrMap_New (AddrMap* map)
+{
+    map->keys = map->values = NULL;
+    map->count = map->capacity = 0;
+}
+
+int
+AddrMap_Destroy (AddrMap* map)
+{
+    free(map->keys);
+    free(map->values);
+    AddrMap_New(map);
+    return 0;
+}
+
+bool
+AddrMap_Get (const AddrMap* map, segaddr_t key, segaddr_t* value)
+{
+    if (map->count == 0 || key == ADDRMAP_EMPTY)
+        return false;
+
+    size_t slot = AddrMap_Slot(map->capacity, key);
+    while (map->keys[slot] != ADDRMAP_EMPTY)
+    {
+        if (map->keys[slot] == key)
+        {
+            if (value != NULL)
+                *value = map->values[slot];
+            return true;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return false;
+}
+
+int
+AddrMap_Set (AddrMap* map, segaddr_t key, segaddr_t value)
+{
+    if (key == ADDRMAP_EMPTY)
+        return -1;
+
+    // keep the load factor at or below one half
+    if (2 * (map->count + 1) > map->capacity)
+    {
+        if (AddrMap_Grow(map, (map->capacity == 0) ? ADDRMAP_MIN_CAPACITY : map->capacity * 2) != 0)
+            return -1;
+    }
+
+    size_t slot = AddrMap_Slot(map->capacity, key);
+    while (map->keys[slot] != ADDRMAP_EMPTY && map->keys[slot] != key)
+        slot = (slot + 1) & (map->capacity - 1);
+
+    if (map->keys[slot] == ADDRMAP_EMPTY)
+        map->count++;
+    map->keys[slot] = key;
+    map->values[slot] = value;
+    return 0;
+}
+
+void
+AddrMap_Clear (AddrMap* map)
+{
+    if (map->keys != NULL)
+        memset(map->keys, 0xFF, map->capacity * sizeof(segaddr_t));
+    map->count = 0;
+}
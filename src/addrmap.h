@@ -0,0 +1,36 @@
+#ifndef ADDRMAP_H_
+#define ADDRMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "segment.h"
+
+/*
+ * Open addressing hash map from segmented address to segmented address. The invalid address (segaddr_t)-1 marks empty
+ * entries and cannot be used as a key.
+ */
+typedef struct AddrMap
+{
+    segaddr_t* keys;
+    segaddr_t* values;
+    size_t count;
+    size_t capacity;
+} AddrMap;
+
+void
+AddrMap_New (AddrMap* map);
+
+int
+AddrMap_Destroy (AddrMap* map);
+
+bool
+AddrMap_Get (const AddrMap* map, segaddr_t key, segaddr_t* value);
+
+int
+AddrMap_Set (AddrMap* map, segaddr_t key, segaddr_t value);
+
+void
+AddrMap_Clear (AddrMap* map);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ *  Copying animations alongside the display lists of the skeletons they animate
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "animation.h"
+#include "macros.h"
+
+/*
+ * AnimationHeader: frame count, frame data, joint indices and the number of values in the frame data that stay the
+ * same on every frame
+ */
+#define SIZEOF_ANIMATION_HEADER 16
+#define SIZEOF_JOINT_INDEX      6
+
+/*
+ * Copies an animation for a skeleton of limbCount limbs: its joint indices, one per limb and one for the root
+ * translation, then the frame data they index, then the header pointing to both. The frame data and joint indices are
+ * deduplicated against everything in the output through its duplicate index, so animations sharing them store them
+ * once, and identical headers are stored once too.
+ */
+int
+Animation_Copy (DisplayListSession* session, segaddr_t segAddr, int limbCount, segaddr_t* newSegAddr)
+{
+    ZObj* obj = session->segments[SEGMENT_NUMBER(segAddr)];
+    const uint8_t* src = (obj == NULL) ? NULL : ZObj_FromSegment(obj, segAddr);
+    uint8_t header[SIZEOF_ANIMATION_HEADER];
+    segaddr_t frameData;
+    segaddr_t jointIndices;
+    segaddr_t newFrameData;
+    segaddr_t newJointIndices;
+    size_t jointsSize = (limbCount + 1) * SIZEOF_JOINT_INDEX;
+    uint32_t numValues;
+    int frameCount;
+    int staticIndexMax;
+
+    *newSegAddr = -1;
+
+    if (src == NULL || SIZEOF_ANIMATION_HEADER > obj->limit - SEGMENT_OFFSET(segAddr))
+        return DisplayList_ErrMsgSet("Bad segmented address 0x%08X for animation header\n", segAddr);
+    memcpy(header, src, SIZEOF_ANIMATION_HEADER);
+
+    frameCount = (int16_t)READ_16_BE(header, 0);
+    frameData = READ_32_BE(header, 4);
+    jointIndices = READ_32_BE(header, 8);
+    staticIndexMax = READ_16_BE(header, 12);
+
+    if (frameCount <= 0)
+        return DisplayList_ErrMsgSet("Animation 0x%08X has %d frames\n", segAddr, frameCount);
+
+    // the joint indices are read from the source to size the frame data, which they index
+    obj = session->segments[SEGMENT_NUMBER(jointIndices)];
+    src = (obj == NULL) ? NULL : ZObj_FromSegment(obj, jointIndices);
+    if (src == NULL || jointsSize > obj->limit - SEGMENT_OFFSET(jointIndices))
+        return DisplayList_ErrMsgSet("Bad segmented address 0x%08X for joint indices of animation 0x%08X\n",
+                                     jointIndices, segAddr);
+
+    // values below staticIndexMax are the same on every frame, the others are followed by one value per frame
+    numValues = staticIndexMax;
+    for (size_t i = 0; i < jointsSize; i += 2)
+    {
+        uint32_t index = READ_16_BE(src, i);
+        uint32_t end = (index < (uint32_t)staticIndexMax) ? index + 1 : index + frameCount;
+
+        if (end > numValues)
+            numValues = end;
+    }
+
+    if (DisplayList_CopyData(session, jointIndices, jointsSize, &newJointIndices, DL_DATA_ANIM_JOINTS) != 0 ||
+        DisplayList_CopyData(session, frameData, numValues * sizeof(int16_t), &newFrameData, DL_DATA_ANIM_FRAMES) != 0)
+        return -1;
+
+    WRITE_32_BE(header, 4, newFrameData);
+    WRITE_32_BE(header, 8, newJointIndices);
+    if (DisplayList_SessionAddData(session, header, SIZEOF_ANIMATION_HEADER, newSegAddr) != 0 ||
+        DisplayList_SessionAddReloc(session, *newSegAddr + 4, frameData, DL_DATA_ANIM_FRAMES) != 0 ||
+        DisplayList_SessionAddReloc(session, *newSegAddr + 8, jointIndices, DL_DATA_ANIM_JOINTS) != 0)
+        return -1;
+    return 0;
+}
+
+static int
+Animation_CopyItem (DisplayListSession* session, size_t i, segaddr_t segAddr, void* arg, segaddr_t* newSegAddr)
+{
+    (void)i;
+    return Animation_Copy(session, segAddr, *(const int*)arg, newSegAddr);
+}
+
+/*
+ * Copies n animations for skeletons of limbCount limbs, see DisplayList_SessionCopyEach. Returns the number that
+ * failed.
+ */
+int
+Animation_CopyBatch (DisplayListSession* session, const segaddr_t* segAddrs, size_t n, int limbCount,
+                     segaddr_t* newSegAddrs)
+{
+    return DisplayList_SessionCopyEach(session, segAddrs, n, "Animation", Animation_CopyItem, &limbCount,
+                                       newSegAddrs);
+}
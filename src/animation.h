@@ -0,0 +1,13 @@
+#ifndef ANIMATION_H_
+#define ANIMATION_H_
+
+#include "displaylist.h"
+
+int
+Animation_Copy (DisplayListSession* session, segaddr_t segAddr, int limbCount, segaddr_t* newSegAddr);
+
+int
+Animation_CopyBatch (DisplayListSession* session, const segaddr_t* segAddrs, size_t n, int limbCount,
+                     segaddr_t* newSegAddrs);
+
+#endif
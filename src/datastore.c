@@ -0,0 +1,390 @@
+/*
+ *  Content addressed store for finding data shared between output objects
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "datastore.h"
+#include "dldata.h"
+#include "errmsg.h"
+#include "json.h"
+
+#define DATASTORE_MIN_CAPACITY 1024
+
+typedef struct DataStoreRef {
+    uint32_t object;
+    uint32_t next;
+} DataStoreRef;
+
+static const char* datastore_type_keys[DL_DATA_MAX] = {
+    [DL_DATA_VTX]     = "vertices",
+    [DL_DATA_TEXTURE] = "texture",
+    [DL_DATA_TLUT]    = "tlut",
+};
+
+static inline size_t
+DataStore_Slot (size_t capacity, const uint8_t* hash)
+{
+    uint64_t key;
+
+    // the hash is already uniform, any part of it will do
+    memcpy(&key, hash, sizeof(key));
+    return key & (capacity - 1);
+}
+
+static inline DataStoreEntry*
+DataStore_Entry (const DataStore* store, uint32_t i)
+{
+    return (DataStoreEntry*)store->entries.start + i;
+}
+
+static int
+DataStore_Grow (DataStore* store)
+{
+    size_t newCapacity = (store->tableCapacity == 0) ? DATASTORE_MIN_CAPACITY : store->tableCapacity * 2;
+    uint32_t* table = malloc(newCapacity * sizeof(uint32_t));
+
+    if (table == NULL)
+        return -1;
+    memset(table, 0xFF, newCapacity * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < store->entries.limit; i++)
+    {
+        size_t slot = DataStore_Slot(newCapacity, DataStore_Entry(store, i)->hash);
+        while (table[slot] != DATASTORE_NONE)
+            slot = (slot + 1) & (newCapacity - 1);
+        table[slot] = i;
+    }
+
+    free(store->table);
+    store->table = table;
+    store->tableCapacity = newCapacity;
+    return 0;
+}
+
+int
+DataStore_New (DataStore* store)
+{
+    pthread_mutex_init(&store->lock, NULL);
+    Vector_New(&store->entries, sizeof(DataStoreEntry));
+    Vector_New(&store->refs, sizeof(DataStoreRef));
+    Vector_New(&store->objects, sizeof(char*));
+    store->table = NULL;
+    store->tableCapacity = 0;
+    store->bytesRecorded = 0;
+    return 0;
+}
+
+int
+DataStore_Free (DataStore* store)
+{
+    DataStoreEntry* entry;
+    char** name;
+
+    VECTOR_FOR_EACH_ELEMENT(&store->entries, entry)
+        free(entry->data);
+    VECTOR_FOR_EACH_ELEMENT(&store->objects, name)
+        free(*name);
+
+    Vector_Destroy(&store->entries);
+    Vector_Destroy(&store->refs);
+    Vector_Destroy(&store->objects);
+    free(store->table);
+    pthread_mutex_destroy(&store->lock);
+    return 0;
+}
+
+/*
+ * Names an output object for the report, returns the number to add its data with or -1 on failure
+ */
+int
+DataStore_AddObject (DataStore* store, const char* name)
+{
+    char* copy = strdup(name);
+    int object = -1;
+
+    pthread_mutex_lock(&store->lock);
+    if (copy != NULL && Vector_PushBack(&store->objects, 1, &copy) != NULL)
+        object = store->objects.limit - 1;
+    else
+        free(copy);
+    pthread_mutex_unlock(&store->lock);
+
+    if (object < 0)
+        return DisplayList_ErrMsgSet("Could not allocate memory for data store object %s\n", name);
+    return object;
+}
+
+/*
+ * Records that size bytes of data were copied into an object. The data is hashed before taking the lock, and only
+ * stored the first time it is seen.
+ */
+int
+DataStore_Add (DataStore* store, int object, int type, const void* data, size_t size)
+{
+    uint8_t hash[SHA256_SIZE];
+    DataStoreEntry* entry = NULL;
+    uint32_t i;
+
+    Sha256(data, size, hash);
+
+    pthread_mutex_lock(&store->lock);
+
+    if (store->tableCapacity != 0)
+    {
+        size_t slot = DataStore_Slot(store->tableCapacity, hash);
+
+        for (; store->table[slot] != DATASTORE_NONE; slot = (slot + 1) & (store->tableCapacity - 1))
+        {
+            if (memcmp(DataStore_Entry(store, store->table[slot])->hash, hash, SHA256_SIZE) == 0)
+            {
+                entry = DataStore_Entry(store, store->table[slot]);
+                break;
+            }
+        }
+    }
+
+    if (entry == NULL)
+    {
+        DataStoreEntry newEntry = { .type = type, .size = size, .numObjects = 1, .sharedSegAddr = -1 };
+        DataStoreRef ref = { object, DATASTORE_NONE };
+
+        memcpy(newEntry.hash, hash, SHA256_SIZE);
+        // keep the table at most half full
+        if ((store->entries.limit + 1) * 2 > store->tableCapacity && DataStore_Grow(store) != 0)
+            goto nomem;
+        newEntry.data = malloc(size);
+        if (newEntry.data == NULL)
+            goto nomem;
+        memcpy(newEntry.data, data, size);
+
+        // a new entry is only added along with its first object, so every entry is in at least one
+        if (Vector_PushBack(&store->refs, 1, &ref) == NULL)
+        {
+            free(newEntry.data);
+            goto nomem;
+        }
+        newEntry.firstRef = store->refs.limit - 1;
+        if (Vector_PushBack(&store->entries, 1, &newEntry) == NULL)
+        {
+            Vector_Erase(&store->refs, store->refs.limit - 1, 1);
+            free(newEntry.data);
+            goto nomem;
+        }
+
+        size_t slot = DataStore_Slot(store->tableCapacity, hash);
+        while (store->table[slot] != DATASTORE_NONE)
+            slot = (slot + 1) & (store->tableCapacity - 1);
+        store->table[slot] = store->entries.limit - 1;
+        store->bytesRecorded += size;
+        pthread_mutex_unlock(&store->lock);
+        return 0;
+    }
+
+    for (i = entry->firstRef; i != DATASTORE_NONE; i = ((DataStoreRef*)store->refs.start)[i].next)
+    {
+        if (((DataStoreRef*)store->refs.start)[i].object == (uint32_t)object)
+            break;
+    }
+    if (i == DATASTORE_NONE)
+    {
+        DataStoreRef ref = { object, entry->firstRef };
+
+        if (Vector_PushBack(&store->refs, 1, &ref) == NULL)
+            goto nomem;
+        entry->firstRef = store->refs.limit - 1;
+        entry->numObjects++;
+        store->bytesRecorded += size;
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return 0;
+nomem:
+    pthread_mutex_unlock(&store->lock);
+    return DisplayList_ErrMsgSet("Could not allocate memory for %lu bytes in the data store\n", size);
+}
+
+/*
+ * What candidates are sorted by, taken out of their entries so that sorting needs no access to the store
+ */
+typedef struct DataStoreSortKey {
+    uint64_t saved;
+    const uint8_t* hash;
+    uint32_t entry;
+} DataStoreSortKey;
+
+static int
+DataStore_CompareObjects (const void* a, const void* b)
+{
+    uint32_t objectA = *(const uint32_t*)a;
+    uint32_t objectB = *(const uint32_t*)b;
+
+    return (objectA > objectB) - (objectA < objectB);
+}
+
+/*
+ * Most bytes saved by sharing first, ties broken by hash so the order does not depend on the order data was added in
+ */
+static int
+DataStore_Compare (const void* a, const void* b)
+{
+    const DataStoreSortKey* keyA = a;
+    const DataStoreSortKey* keyB = b;
+
+    if (keyA->saved != keyB->saved)
+        return (keyA->saved > keyB->saved) ? -1 : 1;
+    return memcmp(keyA->hash, keyB->hash, SHA256_SIZE);
+}
+
+/*
+ * Lists the entries found in at least minObjects objects, called with the lock held
+ */
+static uint32_t*
+DataStore_Candidates (const DataStore* store, uint32_t minObjects, size_t* count)
+{
+    uint32_t* candidates = malloc((store->entries.limit + 1) * sizeof(uint32_t));
+    DataStoreSortKey* keys = malloc((store->entries.limit + 1) * sizeof(DataStoreSortKey));
+
+    *count = 0;
+    if (candidates == NULL || keys == NULL)
+    {
+        free(candidates);
+        free(keys);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < store->entries.limit; i++)
+    {
+        const DataStoreEntry* entry = DataStore_Entry(store, i);
+
+        if (entry->numObjects >= minObjects)
+        {
+            keys[*count] = (DataStoreSortKey){ (uint64_t)entry->size * (entry->numObjects - 1), entry->hash, i };
+            (*count)++;
+        }
+    }
+
+    qsort(keys, *count, sizeof(DataStoreSortKey), DataStore_Compare);
+    for (size_t i = 0; i < *count; i++)
+        candidates[i] = keys[i].entry;
+    free(keys);
+    return candidates;
+}
+
+/*
+ * Copies the data found in at least minObjects objects into shared, returns the number of pieces of data copied or -1
+ */
+int
+DataStore_EmitShared (DataStore* store, ZObj* shared, uint32_t minObjects)
+{
+    size_t count;
+    int ret;
+
+    pthread_mutex_lock(&store->lock);
+
+    uint32_t* candidates = DataStore_Candidates(store, minObjects, &count);
+    if (candidates == NULL)
+    {
+        ret = DisplayList_ErrMsgSet("Could not allocate memory for listing %lu data store entries\n", store->entries.limit);
+        goto end;
+    }
+
+    for (ret = 0; ret < (int)count; ret++)
+    {
+        DataStoreEntry* entry = DataStore_Entry(store, candidates[ret]);
+        void* dst = ZObj_SearchDuplicate(shared, entry->data, entry->size);
+
+        if (dst == NULL)
+        {
+            dst = ZObj_Alloc(shared, entry->size);
+            if (dst == NULL)
+            {
+                ret = DisplayList_ErrMsgSet("Could not allocate memory for %u bytes of shared data\n", entry->size);
+                break;
+            }
+            memcpy(dst, entry->data, entry->size);
+        }
+        entry->sharedSegAddr = ZObj_ToSegment(shared, dst);
+    }
+    free(candidates);
+end:
+    pthread_mutex_unlock(&store->lock);
+    return ret;
+}
+
+/*
+ * Writes the totals of the store and every piece of data found in at least minObjects objects as JSON, along with its
+ * address in the shared object if DataStore_EmitShared was called
+ */
+int
+DataStore_WriteReport (DataStore* store, FILE* file, uint32_t minObjects)
+{
+    uint64_t bytesUnique = 0;
+    uint64_t bytesShared = 0;
+    uint64_t bytesSaved = 0;
+    size_t count;
+
+    pthread_mutex_lock(&store->lock);
+
+    uint32_t* candidates = DataStore_Candidates(store, minObjects, &count);
+    uint32_t* objects = malloc((store->objects.limit + 1) * sizeof(uint32_t));
+    if (candidates == NULL || objects == NULL)
+    {
+        free(candidates);
+        free(objects);
+        pthread_mutex_unlock(&store->lock);
+        return DisplayList_ErrMsgSet("Could not allocate memory for listing %lu data store entries\n", store->entries.limit);
+    }
+
+    for (uint32_t i = 0; i < store->entries.limit; i++)
+        bytesUnique += DataStore_Entry(store, i)->size;
+    for (size_t i = 0; i < count; i++)
+    {
+        const DataStoreEntry* entry = DataStore_Entry(store, candidates[i]);
+
+        bytesShared += entry->size;
+        bytesSaved += (uint64_t)entry->size * (entry->numObjects - 1);
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"objects\": %lu,\n", store->objects.limit);
+    fprintf(file, "  \"entries\": %lu,\n", store->entries.limit);
+    fprintf(file, "  \"bytes_recorded\": %lu,\n", store->bytesRecorded);
+    fprintf(file, "  \"bytes_unique\": %lu,\n", bytesUnique);
+    fprintf(file, "  \"min_objects\": %u,\n", minObjects);
+    fprintf(file, "  \"shared\": { \"entries\": %lu, \"bytes\": %lu, \"bytes_saved\": %lu },\n", count, bytesShared,
+            bytesSaved);
+    fprintf(file, "  \"candidates\": [");
+    for (size_t i = 0; i < count; i++)
+    {
+        const DataStoreEntry* entry = DataStore_Entry(store, candidates[i]);
+
+        fprintf(file, "%s\n    { \"type\": \"%s\", \"size\": %u, \"sha256\": \"", (i == 0) ? "" : ",",
+                datastore_type_keys[entry->type], entry->size);
+        for (int j = 0; j < SHA256_SIZE; j++)
+            fprintf(file, "%02x", entry->hash[j]);
+        fprintf(file, "\",");
+        if (entry->sharedSegAddr != (segaddr_t)-1)
+            fprintf(file, " \"shared_address\": \"%08X\",", entry->sharedSegAddr);
+        // objects are linked in the order threads happened to add them, list them in the order they were named
+        uint32_t numObjects = 0;
+        for (uint32_t j = entry->firstRef; j != DATASTORE_NONE; j = ((DataStoreRef*)store->refs.start)[j].next)
+            objects[numObjects++] = ((DataStoreRef*)store->refs.start)[j].object;
+        qsort(objects, numObjects, sizeof(uint32_t), DataStore_CompareObjects);
+
+        fprintf(file, " \"objects\": [");
+        for (uint32_t j = 0; j < numObjects; j++)
+        {
+            Json_WriteString(file, *(char**)Vector_At(&store->objects, objects[j]));
+            if (j != numObjects - 1)
+                fprintf(file, ", ");
+        }
+        fprintf(file, "] }");
+    }
+    fprintf(file, "%s]\n}\n", (count == 0) ? "" : "\n  ");
+
+    free(objects);
+    free(candidates);
+    pthread_mutex_unlock(&store->lock);
+    return 0;
+}
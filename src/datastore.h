@@ -0,0 +1,63 @@
+#ifndef DATASTORE_H_
+#define DATASTORE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sha256.h"
+#include "vector.h"
+#include "zobj.h"
+
+/*
+ * One distinct piece of data recorded by a DataStore, with the objects it was copied into
+ */
+typedef struct DataStoreEntry {
+    uint8_t hash[SHA256_SIZE];
+    int type;               // DL_DATA_VTX, DL_DATA_TEXTURE or DL_DATA_TLUT
+    uint32_t size;
+    void* data;
+    uint32_t firstRef;      // first of the entry's links in the refs list, DATASTORE_NONE if none
+    uint32_t numObjects;
+    segaddr_t sharedSegAddr; // address in the object written by DataStore_EmitShared, -1 if not in it
+} DataStoreEntry;
+
+/*
+ * Content addressed store of the vertices, textures and TLUTs copied into many output objects, keyed by SHA-256. Data
+ * found in more than one output can be moved into a common object that all of them use. Any number of threads may add
+ * to a store at once.
+ */
+typedef struct DataStore {
+    pthread_mutex_t lock;
+    Vector entries;
+    // entry object lists, linked through each entry
+    Vector refs;
+    // hash table of entry indices, DATASTORE_NONE for empty slots
+    uint32_t* table;
+    size_t tableCapacity;
+    // names of the objects added with DataStore_AddObject
+    Vector objects;
+    uint64_t bytesRecorded; // bytes of data copied into all objects together, each object counted once per entry
+} DataStore;
+
+#define DATASTORE_NONE ((uint32_t)-1)
+
+int
+DataStore_New (DataStore* store);
+
+int
+DataStore_Free (DataStore* store);
+
+int
+DataStore_AddObject (DataStore* store, const char* name);
+
+int
+DataStore_Add (DataStore* store, int object, int type, const void* data, size_t size);
+
+int
+DataStore_EmitShared (DataStore* store, ZObj* shared, uint32_t minObjects);
+
+int
+DataStore_WriteReport (DataStore* store, FILE* file, uint32_t minObjects);
+
+#endif
@@ -1,4 +1,3 @@
-#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -9,481 +8,957 @@
 #include "gbi.h"
 #include "vector.h"
 #include "segment.h"
+#include "gfxop.h"
+#include "gfxscan.h"
 #include "displaylist.h"
 
-static _Thread_local char dl_errmsg[1024];
-
-const char*
-DisplayList_ErrMsg (void)
-{
-    return dl_errmsg;
-}
-
 static void
-DisplayList_ErrMsgClr (void)
+DisplayList_ErrMsgStackTrace (segaddr_t segAddr)
 {
-    memset(dl_errmsg, 0, sizeof(dl_errmsg));
+    DisplayList_ErrMsgAppend("  while processing display list at 0x%08X\n", segAddr);
 }
 
-static int
-DisplayList_ErrMsgSet (const char* fmt, ...)
+static const char* dl_data_type_names[DL_DATA_MAX] = {
+    [DL_DATA_VTX]        = "Vertices",
+    [DL_DATA_MTX]        = "Matrix",
+    [DL_DATA_LIGHT]      = "Light",
+    [DL_DATA_VIEWPORT]   = "Viewport",
+    [DL_DATA_FORCED_MTX] = "Forced Matrix",
+    [DL_DATA_TEXTURE]    = "Texture/Multi Block",
+    [DL_DATA_TLUT]       = "TLUT",
+    [DL_DATA_ANIM_FRAMES] = "Animation Frame Data",
+    [DL_DATA_ANIM_JOINTS] = "Animation Joint Indices",
+};
+
+/*
+ * Finds the source object of the session that an address points into, NULL if the segment has none
+ */
+static inline ZObj*
+DisplayList_SessionSource (DisplayListSession* session, segaddr_t segAddr)
 {
-    va_list ap;
-    va_start(ap, fmt);
-    vsnprintf(dl_errmsg, sizeof(dl_errmsg), fmt, ap);
-    va_end(ap);
-
-    return -1;
+    return session->segments[SEGMENT_NUMBER(segAddr)];
 }
 
-static void
-DisplayList_ErrMsgStackTrace (segaddr_t segAddr)
+/*
+ * Copies size bytes of data from one of the session's source objects into obj2, unless identical data is already
+ * there. Data of every type is found through the same duplicate index of obj2.
+ */
+int
+DisplayList_CopyData (DisplayListSession* session, segaddr_t segAddr, size_t size, segaddr_t* newSegAddr, DLDataType type)
 {
-    char strace[50];
+    ZObj* obj1 = DisplayList_SessionSource(session, segAddr);
+    ZObj* obj2 = session->obj2;
 
-    snprintf(strace, sizeof(strace), "  while processing display list at 0x%08X\n", segAddr);
-    strncat(dl_errmsg, strace, sizeof(dl_errmsg) - strlen(dl_errmsg));
-}
+    DL_STATS_TIME_START(t);
+
+    if (obj1 == NULL)
+        return DisplayList_ErrMsgSet("No source object for segmented address 0x%08X\n", segAddr);
 
-static int
-DisplayList_CopyData (ZObj* obj1, segaddr_t segAddr, size_t size, ZObj* obj2, segaddr_t* newSegAddr, const char* typeName)
-{
     void* src = ZObj_FromSegment(obj1, segAddr);
-    if (src == NULL)
+    if (src == NULL || size > obj1->limit - SEGMENT_OFFSET(segAddr))
         return DisplayList_ErrMsgSet("Bad segmented address 0x%08X for object of size 0x%lX\n", segAddr, obj1->limit);
 
     void* dup = ZObj_SearchDuplicate(obj2, src, size);
+    DL_STATS_TIME_END(&session->stats, data[type].lookupNs, t);
     if (dup != NULL)
     {
         // Already exists in the object, point to it
         *newSegAddr = ZObj_ToSegment(obj2, dup);
+        DL_STATS_ADD(&session->stats, data[type].hits, 1);
+        DL_STATS_ADD(&session->stats, data[type].bytesSaved, size);
     }
     else
     {
         // Doesn't already exist in the object, add new
         void* dst = ZObj_Alloc(obj2, size);
         if (dst == NULL)
-            return DisplayList_ErrMsgSet("Could not allocate memory for %d bytes for %s copied from %08X\n", size, typeName, segAddr);
+            return DisplayList_ErrMsgSet("Could not allocate memory for %lu bytes for %s copied from %08X\n", size, dl_data_type_names[type], segAddr);
 
         memcpy(dst, src, size);
         *newSegAddr = ZObj_ToSegment(obj2, dst);
+        DL_STATS_ADD(&session->stats, data[type].bytesAllocated, size);
+
+        if (session->store != NULL && (type == DL_DATA_VTX || type == DL_DATA_TEXTURE || type == DL_DATA_TLUT) &&
+            DataStore_Add(session->store, session->storeObject, type, src, size) != 0)
+            return -1;
     }
+    DL_STATS_ADD(&session->stats, data[type].count, 1);
+    DL_STATS_TIME_END(&session->stats, data[type].ns, t);
     return 0;
 }
 
-static int
-DisplayList_CopyVtx (ZObj* obj1, segaddr_t segAddr, int n, ZObj* obj2, segaddr_t* newSegAddr)
+typedef struct DedupSuffix {
+    segaddr_t segAddr;
+    uint32_t size;
+} DedupSuffix;
+
+void
+DisplayList_DedupNew (DisplayListDedup* dedup, DLDedupMode mode)
 {
-    return DisplayList_CopyData(obj1, segAddr, n * SIZEOF_VTX, obj2, newSegAddr, "Vertices");
+    dedup->mode = mode;
+    AddrMap_New(&dedup->index);
+    Vector_New(&dedup->suffixes, sizeof(DedupSuffix));
+    Vector_New(&dedup->bounds, sizeof(uint32_t));
+    dedup->numDeduped = dedup->numTails = dedup->bytesSaved = 0;
+    dedup->lastSize = 0;
 }
 
-static int
-DisplayList_CopyMtx (ZObj* obj1, segaddr_t segAddr, ZObj* obj2, segaddr_t* newSegAddr)
+int
+DisplayList_DedupFree (DisplayListDedup* dedup)
 {
-    return DisplayList_CopyData(obj1, segAddr, SIZEOF_MTX, obj2, newSegAddr, "Matrix");
+    Vector_Destroy(&dedup->bounds);
+    Vector_Destroy(&dedup->suffixes);
+    AddrMap_Destroy(&dedup->index);
+    return 0;
 }
 
+/*
+ * Finds where the commands of a display list start, then hashes every suffix starting at one of them into hashes,
+ * longest first. Returns the number of commands.
+ */
 static int
-DisplayList_CopyMovemem (ZObj* obj1, segaddr_t segAddr, uint32_t len, int idx, ZObj* obj2, segaddr_t* newSegAddr)
+DisplayList_HashSuffixes (DisplayListDedup* dedup, const uint8_t* dl, size_t size, uint32_t** hashes)
 {
-    const char* typeName = "Movemem";
+    Vector* bounds = &dedup->bounds;
+    uint32_t pos;
 
-    switch(idx)
+    Vector_Clear(bounds);
+    for (pos = 0; pos < size; pos += gfx_ops[dl[pos]].len)
     {
-        case G_MV_VIEWPORT:
-            typeName = "Viewport";
-            break;
-        case G_MV_LIGHT:
-            typeName = "Light";
+        if (Vector_PushBack(bounds, 2, NULL) == NULL)
+            return -1;
+        ((uint32_t*)bounds->start)[bounds->limit / 2 - 1] = pos;
+    }
+
+    // the second half of bounds holds the hashes
+    size_t n = bounds->limit / 2;
+    uint32_t* offsets = bounds->start;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    *hashes = offsets + n;
+    for (size_t i = n; i-- > 0;)
+    {
+        uint32_t end = (i + 1 < n) ? offsets[i + 1] : size;
+
+        for (uint32_t j = offsets[i]; j < end; j += 4)
+            hash = (hash ^ READ_32_BE(dl, j)) * 0x100000001B3ULL;
+        (*hashes)[i] = (uint32_t)(hash ^ (hash >> 32));
+        // (segaddr_t)-1 is not a valid AddrMap key
+        if ((*hashes)[i] == (uint32_t)-1)
+            (*hashes)[i] = 0;
+    }
+    return n;
+}
+
+/*
+ * Whether a display list can be cut before command i without cutting a texture or TLUT load macro in two, so that both
+ * parts still decode to the same references. Such a macro starts with a G_SETTIMG and is at most 7 commands long.
+ */
+static bool
+DisplayList_CanSplit (const uint8_t* dl, const uint32_t* bounds, int i)
+{
+    for (int j = (i > 6) ? i - 6 : 0; j < i; j++)
+    {
+        if (gfx_ops[dl[bounds[j]]].opClass == GFX_OP_SETTIMG)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Adds a copied display list, with every pointer in it already patched, to obj2. Depending on the dedup mode an
+ * identical display list already added is used instead, or the longest tail of at least two commands that matches one
+ * already added is replaced by a branch to it. dedup may be NULL to always add the display list as it is.
+ */
+int
+DisplayList_Emit (DisplayListDedup* dedup, ZObj* obj2, const uint8_t* dl, size_t size, segaddr_t* newSegAddr)
+{
+    uint32_t* hashes;
+    int n;
+    int match = -1;
+    segaddr_t matchAddr = 0;
+    uint8_t* dst;
+
+    if (dedup == NULL || dedup->mode == DL_DEDUP_NONE)
+    {
+        dst = ZObj_Alloc(obj2, size);
+        if (dst == NULL)
+            goto nomem;
+        memcpy(dst, dl, size);
+        *newSegAddr = ZObj_ToSegment(obj2, dst);
+        if (dedup != NULL)
+            dedup->lastSize = size;
+        return 0;
+    }
+
+    n = DisplayList_HashSuffixes(dedup, dl, size, &hashes);
+    if (n < 0)
+        goto nomem;
+
+    for (int i = 0; i < n; i++)
+    {
+        // a tail of one command is not worth a branch, that would be one command too
+        if (i > 0 && (dedup->mode != DL_DEDUP_TAILS || i > n - 2))
             break;
-        case G_MV_MATRIX:
-            typeName = "Forced Matrix";
+
+        uint32_t pos = ((uint32_t*)dedup->bounds.start)[i];
+        uint32_t j;
+
+        if (!DisplayList_CanSplit(dl, dedup->bounds.start, i) || !AddrMap_Get(&dedup->index, hashes[i], &j))
+            continue;
+
+        const DedupSuffix* suffix = Vector_At(&dedup->suffixes, j);
+        if (suffix->size == size - pos && memcmp(ZObj_FromSegment(obj2, suffix->segAddr), dl + pos, suffix->size) == 0)
+        {
+            match = i;
+            matchAddr = suffix->segAddr;
             break;
-        case G_MV_MMTX:
-        case G_MV_PMTX:
-        case G_MV_POINT:
-        default:
-            return DisplayList_ErrMsgSet("Unrecognized Movemem Index %d for data at %08X\n", idx, segAddr);
+        }
+    }
+
+    if (match == 0)
+    {
+        *newSegAddr = matchAddr;
+        dedup->lastSize = 0;
+        dedup->numDeduped++;
+        dedup->bytesSaved += size;
+        return 0;
     }
-    return DisplayList_CopyData(obj1, segAddr, len, obj2, newSegAddr, typeName);
+
+    uint32_t newSize = size;
+    if (match > 0)
+    {
+        // the tail is replaced by a single branch
+        newSize = ((uint32_t*)dedup->bounds.start)[match] + SIZEOF_GFX;
+        dedup->numTails++;
+        dedup->bytesSaved += size - newSize;
+    }
+
+    dst = ZObj_Alloc(obj2, newSize);
+    if (dst == NULL)
+        goto nomem;
+    memcpy(dst, dl, newSize);
+    if (match > 0)
+    {
+        WRITE_32_BE(dst, newSize - SIZEOF_GFX, (uint32_t)G_DL << 24 | G_DL_NOPUSH << 16);
+        WRITE_32_BE(dst, newSize - SIZEOF_GFX + 4, matchAddr);
+    }
+    *newSegAddr = ZObj_ToSegment(obj2, dst);
+    dedup->lastSize = newSize;
+
+    // what was added can be matched by later display lists, the suffixes of a shortened one are hashed again
+    if (match > 0 && (n = DisplayList_HashSuffixes(dedup, dst, newSize, &hashes)) < 0)
+        goto nomem;
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t pos = ((uint32_t*)dedup->bounds.start)[i];
+        DedupSuffix suffix = { *newSegAddr + pos, newSize - pos };
+
+        if (AddrMap_Get(&dedup->index, hashes[i], NULL))
+            continue;
+        if (Vector_PushBack(&dedup->suffixes, 1, &suffix) == NULL ||
+            AddrMap_Set(&dedup->index, hashes[i], dedup->suffixes.limit - 1) != 0)
+            goto nomem;
+    }
+    return 0;
+nomem:
+    return DisplayList_ErrMsgSet("Could not allocate memory for display list %lu bytes long\n", size);
 }
 
 size_t
 DisplayList_Length (ZObj* obj, segaddr_t segAddr)
 {
-    uint8_t* start = ZObj_FromSegment(obj, segAddr);
-    uint8_t* data = start;
-    size_t size = obj->limit;
+    const uint8_t* start = ZObj_FromSegment(obj, segAddr);
+    const uint8_t* data = start;
+    const uint8_t* end = (uint8_t*)obj->buffer + obj->limit;
     bool exit = false;
-    size_t dlLen = 0;
 
+    // display lists are scanned to the end of one buffer, which a chunked object does not have
+    if (obj->chunkSize != 0)
+        return DisplayList_ErrMsgSet("Display list %08X is in a chunked object, flatten it first\n", segAddr);
     if (start == NULL)
         return DisplayList_ErrMsgSet("Bad segmented address %08X\n", segAddr);
 
-    while (!exit && data < start + size)
+    while (!exit)
     {
-        size_t cmdlen = SIZEOF_GFX;
-        uint32_t w0 = READ_32_BE(data, 0);
+        // runs of ordinary commands are skipped in bulk, leaving the ones below
+        data = GfxScan_Skip(data, end);
+        if (end - data < SIZEOF_GFX)
+            break;
 
-        uint8_t cmd = w0 >> 24;
+        const GfxOp* op = &gfx_ops[data[0]];
 
-        switch (cmd)
+        switch (op->opClass)
         {
-            case G_DL:
-                if (SHIFTR(w0, 16, 8) == G_DL_PUSH)
+            case GFX_OP_DL:
+                if (data[1] == G_DL_PUSH)
                     break;
                 FALLTHROUGH;
-            case G_ENDDL:
+            case GFX_OP_ENDDL:
                 exit = true;
                 break;
 
-            case G_TEXRECTFLIP:
-            case G_TEXRECT:
-                // These commands are 128 bits rather than the usual 64 bits
-                cmdlen = 16;
-                break;
-
-            case G_RDPHALF_2:
-            case G_SETOTHERMODE_H:
-            case G_SETOTHERMODE_L:
-            case G_RDPHALF_1:
-            case G_SPNOOP:
-            case G_GEOMETRYMODE:
-            case G_POPMTX:
-            case G_TEXTURE:
-            case G_SPECIAL_1:
-            case G_SPECIAL_2:
-            case G_SPECIAL_3:
-            case G_MODIFYVTX:
-            case G_CULLDL:
-            case G_BRANCH_Z:
-            case G_TRI1:
-            case G_TRI2:
-            case G_QUAD:
-            case G_LINE3D:
-            case G_NOOP:
-            case G_SETCOMBINE:
-            case G_SETENVCOLOR:
-            case G_SETPRIMCOLOR:
-            case G_SETBLENDCOLOR:
-            case G_SETFOGCOLOR:
-            case G_SETFILLCOLOR:
-            case G_FILLRECT:
-            case G_RDPSETOTHERMODE:
-            case G_SETPRIMDEPTH:
-            case G_SETSCISSOR:
-            case G_SETCONVERT:
-            case G_SETKEYR:
-            case G_SETKEYGB:
-            case G_RDPFULLSYNC:
-            case G_RDPTILESYNC:
-            case G_RDPPIPESYNC:
-            case G_RDPLOADSYNC:
-            case G_MOVEMEM:
-            case G_MTX:
-            case G_VTX:
-            case G_SETTIMG:
-            case G_SETTILE:
-            case G_LOADTILE:
-            case G_LOADBLOCK:
-            case G_SETTILESIZE:
-            case G_LOADTLUT:
-            case G_MOVEWORD:
-            case G_DMA_IO:
-            case G_LOAD_UCODE:
-            case G_SETCIMG:
-            case G_SETZIMG:
-                break;
+            case GFX_OP_INVALID:
+                return DisplayList_ErrMsgSet("Invalid command %02X encountered while determining length of display list at %08X\n", data[0], segAddr);
 
             default:
-                return DisplayList_ErrMsgSet("Invalid command %02X encountered while determining length of display list at %08X\n", cmd, segAddr);
+                break;
         }
-        dlLen += cmdlen;
-        data += cmdlen;
+
+        if (end - data < op->len)
+            break;
+        data += op->len;
     }
     if (!exit)
         return DisplayList_ErrMsgSet("Hit end of object before finding G_ENDDL\n");
 
     DisplayList_ErrMsgClr();
-    return dlLen;
+    return data - start;
 }
 
-int
-DisplayList_Copy (ZObj* obj1, segaddr_t segAddr, ZObj* obj2, segaddr_t* newSegAddr)
+void
+DisplayList_DecoderInit (DisplayListDecoder* dec)
 {
-    // last 8 commands
-    int i = 0;
-    uint8_t history[8] = { G_NOOP };
-
-#define HISTORY_GET(n) \
-    history[(i - 1 - (n) < 0) ? (i - 1 - (n) + ARRLEN(history)) : (i - 1 - (n))]
-
-    // texture engine state tracker
-    struct {
-        int fmt;
-        int siz;
-        uint32_t width;
-        uint32_t dram;
-    } timg = { 0 };
-
-    int lastTimgPos = -1;
-
-    struct {
-        // SetTile
-        int fmt;
-        int siz;
-        int line;
-        uint16_t tmem;
-        int pal;
-        int cms;
-        int cmt;
-        int masks;
-        int maskt;
-        int shifts;
-        int shiftt;
-        // SetTileSize
-        qu102_t uls;
-        qu102_t ult;
-        qu102_t lrs;
-        qu102_t lrt;
-    } tileDescriptors[8] = { 0 };
-
-    // display list
-    uint8_t* start;
-    uint8_t* data;
-    size_t size;
-    bool exit;
-    int ret;
+    memset(dec, 0, sizeof(DisplayListDecoder));
+}
 
-    Vector dlVec;
-    size_t dlLen;
+static inline bool
+DisplayList_DecoderAddressValid (const DisplayListDecoder* dec, ZObj* obj, segaddr_t segAddr)
+{
+    if (dec->segments != NULL)
+        return dec->segments[SEGMENT_NUMBER(segAddr)] != NULL;
+    return ZObj_AddressValid(obj, segAddr);
+}
 
-    dlLen = DisplayList_Length(obj1, segAddr);
-    if (dlLen == -1)
-        return -1;
+/*
+ * Finds what the command at offset pos of the display list at segAddr points to, if anything. Pointers to other
+ * segments are not references, unless the decoder has a segment table with an object for them. Texture and TLUT
+ * loads are only recognized as the whole macros that load them, their reference is to the G_SETTIMG at the start of
+ * the macro. Every command of the display list has to be passed in order, each exactly once.
+ */
+int
+DisplayList_Decode (DisplayListDecoder* dec, ZObj* obj, segaddr_t segAddr, uint32_t pos, const uint8_t* data,
+                    DisplayListRef* ref)
+{
+#define HISTORY_GET(n) \
+    dec->history[(dec->historyPos + ARRLEN(dec->history) - 1 - (n)) % ARRLEN(dec->history)]
 
-    Vector_New(&dlVec, SIZEOF_GFX);
-    Vector_Reserve(&dlVec, dlLen / SIZEOF_GFX);
+    uint32_t w0 = READ_32_BE(data, 0);
+    uint32_t w1 = READ_32_BE(data, 4);
+    int cmd = w0 >> 24;
 
-    start = ZObj_FromSegment(obj1, segAddr);
-    data = start;
-    size = obj1->limit;
-    exit = false;
-    ret = 0;
+    ref->type = DL_REF_NONE;
+    ref->segAddr = w1;
+    ref->patchPos = pos;
 
-    while (!exit && data < start + size)
+    switch (gfx_ops[cmd].opClass)
     {
-        size_t cmdlen = SIZEOF_GFX;
-        uint32_t w0 = READ_32_BE(data, 0);
-        uint32_t w1 = READ_32_BE(data, 4);
+        /*
+         * These commands contain pointers
+         */
 
-        int cmd = w0 >> 24;
-        switch (cmd)
-        {
-            /*
-             * These commands contain pointers, except G_ENDDL which is here for convenience
-             */
-
-            case G_DL:
-                // recursively copy called display lists
-                if (ZObj_AddressValid(obj1, w1)) {
-                    ret = DisplayList_Copy(obj1, w1, obj2, &w1);
-                    if (ret != 0)
-                    {
-                        DisplayList_ErrMsgStackTrace(w1);
-                        goto err;
-                    }
-                }
-                // if not branchlist, carry on
-                if (SHIFTR(w0, 16, 8) == G_DL_PUSH)
-                    break;
-                // if branchlist, exit
-                FALLTHROUGH;
-            case G_ENDDL:
-                // exit
-                exit = true;
-                break;
+        case GFX_OP_DL:
+            if (DisplayList_DecoderAddressValid(dec, obj, w1))
+                ref->type = DL_REF_DL;
+            break;
 
-            case G_MOVEMEM:
-                if (ZObj_AddressValid(obj1, w1)) {
-                    ret = DisplayList_CopyMovemem(obj1, w1, SHIFTR(w0, 19,  5) * 8 + 1, SHIFTR(w0,  0,  8), obj2, &w1);
-                    if (ret != 0)
-                        goto err;
-                }
-                break;
+        case GFX_OP_MOVEMEM:
+            if (DisplayList_DecoderAddressValid(dec, obj, w1))
+            {
+                int idx = SHIFTR(w0,  0,  8);
 
-            case G_MTX:
-                if (ZObj_AddressValid(obj1, w1)) {
-                    ret = DisplayList_CopyMtx(obj1, w1, obj2, &w1);
-                    if (ret != 0)
-                        goto err;
+                switch (idx)
+                {
+                    case G_MV_VIEWPORT:
+                        ref->type = DL_DATA_VIEWPORT;
+                        break;
+                    case G_MV_LIGHT:
+                        ref->type = DL_DATA_LIGHT;
+                        break;
+                    case G_MV_MATRIX:
+                        ref->type = DL_DATA_FORCED_MTX;
+                        break;
+                    case G_MV_MMTX:
+                    case G_MV_PMTX:
+                    case G_MV_POINT:
+                    default:
+                        return DisplayList_ErrMsgSet("Unrecognized Movemem Index %d for data at %08X\n", idx, w1);
                 }
-                break;
+                ref->size = SHIFTR(w0, 19,  5) * 8 + 1;
+            }
+            break;
 
-            case G_VTX:
-                if (ZObj_AddressValid(obj1, w1)) {
-                    ret = DisplayList_CopyVtx(obj1, w1, SHIFTR(w0, 12, 8), obj2, &w1);
-                    if (ret != 0)
-                        goto err;
-                }
-                break;
+        case GFX_OP_MTX:
+            if (DisplayList_DecoderAddressValid(dec, obj, w1))
+            {
+                ref->type = DL_DATA_MTX;
+                ref->size = SIZEOF_MTX;
+            }
+            break;
 
-            /*
-             * Texture and TLUT Loading
-             */
+        case GFX_OP_VTX:
+            if (DisplayList_DecoderAddressValid(dec, obj, w1))
+            {
+                ref->type = DL_DATA_VTX;
+                ref->size = SHIFTR(w0, 12, 8) * SIZEOF_VTX;
+            }
+            break;
 
-            case G_SETTIMG:
-                timg.fmt =   SHIFTR(w0, 21, 3);
-                timg.siz =   SHIFTR(w0, 19, 2);
-                timg.width = SHIFTR(w0, 0, 12) + 1;
-                timg.dram =  w1;
+        /*
+         * Texture and TLUT Loading
+         */
 
-                lastTimgPos = dlVec.limit;
-                break;
+        case GFX_OP_SETTIMG:
+            dec->timgFmt =  SHIFTR(w0, 21, 3);
+            dec->timgSiz =  SHIFTR(w0, 19, 2);
+            dec->timgDram = w1;
 
-            case G_SETTILE:
-                {
-                    int tile = SHIFTR(w1, 24, 3);
-
-                    tileDescriptors[tile].fmt =     SHIFTR(w0, 21, 3);
-                    tileDescriptors[tile].siz =     SHIFTR(w0, 19, 2);
-                    tileDescriptors[tile].line =    SHIFTR(w0,  9, 9);
-                    tileDescriptors[tile].tmem =    SHIFTR(w0,  0, 9);
-                    tileDescriptors[tile].pal =     SHIFTR(w1, 20, 4);
-                    tileDescriptors[tile].cms =     SHIFTR(w1,  8, 2);
-                    tileDescriptors[tile].cmt =     SHIFTR(w1, 18, 2);
-                    tileDescriptors[tile].masks =   SHIFTR(w1,  4, 4);
-                    tileDescriptors[tile].maskt =   SHIFTR(w1, 14, 4);
-                    tileDescriptors[tile].shifts =  SHIFTR(w1,  0, 4);
-                    tileDescriptors[tile].shiftt =  SHIFTR(w1, 10, 4);
-                }
-                break;
+            dec->lastTimgPos = pos;
+            break;
 
-            case G_LOADTILE:
-            case G_LOADBLOCK:
-                // These commands are only used inside larger texture macros, so we don't need to do anything special with them
-                break;
+        case GFX_OP_SETTILE:
+            dec->tiles[SHIFTR(w1, 24, 3)].siz = SHIFTR(w0, 19, 2);
+            break;
 
-            case G_SETTILESIZE:
+        case GFX_OP_SETTILESIZE:
+            {
+                int tile = SHIFTR(w1, 24, 3);
+
+                dec->tiles[tile].lrs = SHIFTR(w1, 12, 12);
+                dec->tiles[tile].lrt = SHIFTR(w1,  0, 12);
+            }
+
+            if (HISTORY_GET(0) == G_SETTILE &&
+                HISTORY_GET(1) == G_RDPPIPESYNC &&
+                HISTORY_GET(2) == G_LOADBLOCK &&
+                HISTORY_GET(3) == G_RDPLOADSYNC &&
+                HISTORY_GET(4) == G_SETTILE &&
+                HISTORY_GET(5) == G_SETTIMG)
+            {
+                int tile = SHIFTR(w1, 24, 3);
+                // gsDPLoadTextureBlock / gsDPLoadMultiBlock
+                uint32_t addr = dec->timgDram;
+                int siz = dec->tiles[tile].siz;
+                uint32_t width = qu102_I(dec->tiles[tile].lrs) + 1;
+                uint32_t height = qu102_I(dec->tiles[tile].lrt) + 1;
+
+                if (DisplayList_DecoderAddressValid(dec, obj, addr))
                 {
-                    int tile = SHIFTR(w1, 24, 3);
-
-                    tileDescriptors[tile].uls =  SHIFTR(w0, 12, 12);
-                    tileDescriptors[tile].ult =  SHIFTR(w0,  0, 12);
-                    tileDescriptors[tile].lrs =  SHIFTR(w1, 12, 12);
-                    tileDescriptors[tile].lrt =  SHIFTR(w1,  0, 12);
+                    ref->type = DL_DATA_TEXTURE;
+                    ref->segAddr = addr;
+                    ref->size = G_SIZ_BYTES(siz) * width * height;
+                    ref->patchPos = dec->lastTimgPos;
                 }
+            }
+            break;
 
-                if (HISTORY_GET(0) == G_SETTILE &&
-                    HISTORY_GET(1) == G_RDPPIPESYNC &&
-                    HISTORY_GET(2) == G_LOADBLOCK &&
-                    HISTORY_GET(3) == G_RDPLOADSYNC &&
-                    HISTORY_GET(4) == G_SETTILE &&
-                    HISTORY_GET(5) == G_SETTIMG)
+        case GFX_OP_LOADTLUT:
+            if (HISTORY_GET(0) == G_RDPLOADSYNC &&
+                HISTORY_GET(1) == G_SETTILE &&
+                HISTORY_GET(2) == G_RDPTILESYNC &&
+                HISTORY_GET(3) == G_SETTIMG &&
+               (dec->timgFmt == G_IM_FMT_RGBA || dec->timgFmt == G_IM_FMT_IA) &&
+                dec->timgSiz == G_IM_SIZ_16b)
+            {
+                // gsDPLoadTLUT / gsDPLoadTLUT_pal16 / gsDPLoadTLUT_pal256
+                uint32_t addr = dec->timgDram;
+                uint32_t count = SHIFTR(w1, 14, 10) + 1;
+
+                if (DisplayList_DecoderAddressValid(dec, obj, addr))
                 {
-                    int tile = SHIFTR(w1, 24, 3);
-                    // gsDPLoadTextureBlock / gsDPLoadMultiBlock
-                    uint32_t addr = timg.dram;
-                    int siz = tileDescriptors[tile].siz;
-                    uint32_t width = qu102_I(tileDescriptors[tile].lrs) + 1;
-                    uint32_t height = qu102_I(tileDescriptors[tile].lrt) + 1;
-
-                    if (ZObj_AddressValid(obj1, addr))
-                    {
-                        segaddr_t newAddr;
-                        size_t size = G_SIZ_BYTES(siz) * width * height;
-                        ret = DisplayList_CopyData(obj1, addr, size, obj2, &newAddr, "Texture/Multi Block");
-                        if (ret != 0)
-                            goto err;
-
-                        void* lastTimg = Vector_At(&dlVec, lastTimgPos);
-                        WRITE_32_BE(lastTimg, 4, newAddr);
-                    }
+                    ref->type = DL_DATA_TLUT;
+                    ref->segAddr = addr;
+                    ref->size = ALIGN8(G_SIZ_BYTES(G_IM_SIZ_16b) * count);
+                    ref->patchPos = dec->lastTimgPos;
                 }
-                break;
+            }
+            break;
 
-            case G_LOADTLUT:
-                if (HISTORY_GET(0) == G_RDPLOADSYNC &&
-                    HISTORY_GET(1) == G_SETTILE &&
-                    HISTORY_GET(2) == G_RDPTILESYNC &&
-                    HISTORY_GET(3) == G_SETTIMG &&
-                   (timg.fmt == G_IM_FMT_RGBA || timg.fmt == G_IM_FMT_IA) &&
-                    timg.siz == G_IM_SIZ_16b)
-                {
-                    // gsDPLoadTLUT / gsDPLoadTLUT_pal16 / gsDPLoadTLUT_pal256
-                    uint32_t addr = timg.dram;
-                    uint32_t count = SHIFTR(w1, 14, 10) + 1;
-
-                    if (ZObj_AddressValid(obj1, addr))
-                    {
-                        segaddr_t newAddr;
-                        size_t size = ALIGN8(G_SIZ_BYTES(G_IM_SIZ_16b) * count);
-                        ret = DisplayList_CopyData(obj1, addr, size, obj2, &newAddr, "TLUT");
-                        if (ret != 0)
-                            goto err;
-
-                        void* lastTimg = Vector_At(&dlVec, lastTimgPos);
-                        WRITE_32_BE(lastTimg, 4, newAddr);
-                    }
-                }
-                break;
+        /*
+         * These should not appear in objects
+         */
 
-            /*
-             * These commands are 128 bits rather than the usual 64 bits
-             */
+        case GFX_OP_FORBIDDEN:
+            return DisplayList_ErrMsgSet("Unimplemented display list command %02X encountered in %08X\n", cmd, segAddr);
 
-            case G_TEXRECTFLIP:
-            case G_TEXRECT:
-                cmdlen = 16;
-                break;
+        case GFX_OP_INVALID:
+            return DisplayList_ErrMsgSet("Invalid command %02X encountered while determining length of display list at %08X\n", cmd, segAddr);
 
-            /*
-             * These should not appear in objects
-             */
+        /*
+         * All other valid commands do not need any special handling
+         */
 
-            case G_MOVEWORD:
-            case G_DMA_IO:
-            case G_LOAD_UCODE:
-            case G_SETCIMG:
-            case G_SETZIMG:
-                ret = DisplayList_ErrMsgSet("Unimplemented display list command %02X encountered in %08X\n", cmd, segAddr);
-                goto err;
+        default:
+            break;
+    }
+#undef HISTORY_GET
+
+    // Update history ringbuffer
+    dec->history[dec->historyPos] = cmd;
+    dec->historyPos = (dec->historyPos + 1) % ARRLEN(dec->history);
+    return 0;
+}
 
-            /*
-             * All other commands do not need any special handling, we know they are valid from the length check
-             */
+/*
+ * Decoding state of one display list being copied, kept on the session's frame stack rather than the C stack
+ */
+typedef struct CopyFrame {
+    segaddr_t segAddr;
+    ZObj* obj;              // source object holding the display list
+    size_t pos;             // offset in obj of the next command to decode
+    size_t dlBase;          // first element of the scratch vector holding the commands decoded so far
+    size_t patchBase;       // first element of the session's patches made in this display list
+    DisplayListDecoder decoder;
+} CopyFrame;
+
+enum {
+    STEP_DONE,  // the display list was copied
+    STEP_CALL,  // a called display list has to be copied first
+    STEP_ERROR,
+};
 
-            default:
-                break;
+static int
+DisplayList_PushFrame (DisplayListSession* session, segaddr_t segAddr)
+{
+    CopyFrame* frame;
+
+    if (session->maxDepth > 0 && session->frames.limit >= (size_t)session->maxDepth)
+        return DisplayList_ErrMsgSet("Display lists nested more than %d deep at %08X\n", session->maxDepth, segAddr);
+
+    frame = Vector_PushBack(&session->frames, 1, NULL);
+    if (frame == NULL)
+        return DisplayList_ErrMsgSet("Could not allocate memory for display list copied from %08X\n", segAddr);
+
+    frame->segAddr = segAddr;
+    frame->obj = DisplayList_SessionSource(session, segAddr);
+    frame->pos = SEGMENT_OFFSET(segAddr);
+    frame->dlBase = session->scratch.limit;
+    frame->patchBase = session->patches.limit;
+    DisplayList_DecoderInit(&frame->decoder);
+    frame->decoder.segments = session->segments;
+    DL_STATS_MAX(&session->stats, maxDepth, session->frames.limit);
+
+    // the frame stays pushed on error so that it shows up in the stack trace
+    if (frame->obj == NULL || ZObj_FromSegment(frame->obj, segAddr) == NULL)
+        return DisplayList_ErrMsgSet("Bad segmented address %08X\n", segAddr);
+    return 0;
+}
+
+/*
+ * Notes a pointer patched at offset pos of the display list being copied, to be recorded once it is added to obj2.
+ * Pointers that were not patched to somewhere in obj2, such as those to data of no size, are left out.
+ */
+static int
+DisplayList_PushPatch (DisplayListSession* session, uint32_t pos, segaddr_t oldAddr, segaddr_t newAddr, int kind)
+{
+    Reloc patch = { pos + 4, oldAddr, newAddr, kind };
+
+    if (session->relocs == NULL || ZObj_FromSegment(session->obj2, newAddr) == NULL)
+        return 0;
+    if (Vector_PushBack(&session->patches, 1, &patch) == NULL)
+        return DisplayList_ErrMsgSet("Could not record relocation of %08X\n", oldAddr);
+    return 0;
+}
+
+/*
+ * Records the pointers patched in the display list of frame, just added to obj2 at segAddr. Nothing was added if an
+ * identical display list was reused, whose pointers were recorded when it was added. A tail replaced by a branch takes
+ * its patches with it, the branch is recorded instead as pointing into obj2 both before and after.
+ */
+static int
+DisplayList_AddPatches (DisplayListSession* session, CopyFrame* frame, segaddr_t segAddr, size_t dlLen)
+{
+    uint32_t size = session->dedup.lastSize;
+    uint32_t keep = (size < dlLen) ? size - SIZEOF_GFX : size;
+
+    if (session->relocs == NULL || size == 0)
+        return 0;
+
+    for (size_t i = frame->patchBase; i < session->patches.limit; i++)
+    {
+        const Reloc* patch = Vector_At(&session->patches, i);
+
+        if (patch->offset < keep &&
+            Reloc_Add(session->relocs, SEGMENT_OFFSET(segAddr) + patch->offset, patch->oldAddr, patch->newAddr,
+                      patch->kind) != 0)
+            return -1;
+    }
+    if (keep < size)
+    {
+        segaddr_t target = READ_32_BE(ZObj_FromSegment(session->obj2, segAddr + keep), 4);
+
+        return Reloc_Add(session->relocs, SEGMENT_OFFSET(segAddr) + keep + 4, target, target, DL_REF_DL);
+    }
+    return 0;
+}
+
+/*
+ * Decodes commands of the display list in frame into the scratch vector until it ends or calls a display list that
+ * was not copied yet. In that case the frame is left on the G_DL, which is decoded again once the called list is done.
+ */
+static int
+DisplayList_Step (DisplayListSession* session, CopyFrame* frame, segaddr_t* addr)
+{
+    ZObj* obj1 = frame->obj;
+    ZObj* obj2 = session->obj2;
+    Vector* dlVec = &session->scratch;
+    segaddr_t segAddr = frame->segAddr;
+
+    // display list
+    uint8_t* start = (uint8_t*)obj1->buffer + SEGMENT_OFFSET(segAddr);
+    uint8_t* data = (uint8_t*)obj1->buffer + frame->pos;
+    uint8_t* end = (uint8_t*)obj1->buffer + obj1->limit;
+    bool exit = false;
+    size_t dlLen;
+
+    while (!exit && end - data >= SIZEOF_GFX)
+    {
+        const GfxOp* op = &gfx_ops[data[0]];
+        uint32_t pos = data - start;
+        uint32_t w1 = READ_32_BE(data, 4);
+        DisplayListRef ref;
+
+        // called display lists are copied first, unless they were already copied in this session
+        if (op->opClass == GFX_OP_DL && DisplayList_SessionSource(session, w1) != NULL &&
+            !AddrMap_Get(&session->dlMap, w1, &w1))
+        {
+            frame->pos = data - (uint8_t*)obj1->buffer;
+            *addr = w1;
+            return STEP_CALL;
         }
 
+        if (DisplayList_Decode(&frame->decoder, obj1, segAddr, pos, data, &ref) != 0)
+            return STEP_ERROR;
+
+        if (ref.type == DL_REF_DL)
+        {
+            DL_STATS_ADD(&session->stats, numReused, 1);
+            if (DisplayList_PushPatch(session, pos, ref.segAddr, w1, DL_REF_DL) != 0)
+                return STEP_ERROR;
+        }
+        else if (ref.type != DL_REF_NONE)
+        {
+            segaddr_t newAddr = 0;
+
+            if (DisplayList_CopyData(session, ref.segAddr, ref.size, &newAddr, ref.type) != 0)
+                return STEP_ERROR;
+            if (DisplayList_PushPatch(session, ref.patchPos, ref.segAddr, newAddr, ref.type) != 0)
+                return STEP_ERROR;
+
+            // texture loads point the G_SETTIMG that started them at the copy
+            if (ref.patchPos == pos)
+                w1 = newAddr;
+            else
+                WRITE_32_BE(Vector_At(dlVec, frame->dlBase + ref.patchPos / SIZEOF_GFX), 4, newAddr);
+        }
+
+        if (op->opClass == GFX_OP_ENDDL || (op->opClass == GFX_OP_DL && data[1] != G_DL_PUSH))
+            exit = true;
+
+        if (end - data < op->len)
+            break;
+
         // Copy display list command and overwrite w1
-        void* written = Vector_PushBack(&dlVec, cmdlen / SIZEOF_GFX, data);
+        void* written = Vector_PushBack(dlVec, op->len / SIZEOF_GFX, data);
+        if (written == NULL)
+        {
+            DisplayList_ErrMsgSet("Could not allocate memory for display list copied from %08X\n", segAddr);
+            return STEP_ERROR;
+        }
         WRITE_32_BE(written, 4, w1);
 
         // Increment to next command
-        data += cmdlen;
+        data += op->len;
+    }
 
-        // Update history ringbuffer
-        history[i] = cmd;
-        i = (i + 1) % ARRLEN(history);
+    if (!exit)
+    {
+        DisplayList_ErrMsgSet("Hit end of object before finding G_ENDDL\n");
+        return STEP_ERROR;
     }
 
     // Copy display list to destination zobj
-    void* newDl = ZObj_Alloc(obj2, dlLen);
-    if (newDl == NULL)
+    dlLen = (dlVec->limit - frame->dlBase) * SIZEOF_GFX;
+    if (DisplayList_Emit(&session->dedup, obj2, Vector_At(dlVec, frame->dlBase), dlLen, addr) != 0)
+    {
+        DisplayList_ErrMsgSet("Could not allocate memory for display list %lu bytes long copied from %08X\n", dlLen, segAddr);
+        return STEP_ERROR;
+    }
+
+    if (DisplayList_AddPatches(session, frame, *addr, dlLen) != 0)
+        return STEP_ERROR;
+
+    DL_STATS_ADD(&session->stats, numDisplayLists, 1);
+    DL_STATS_ADD(&session->stats, dlBytes, dlLen);
+    if (AddrMap_Set(&session->dlMap, segAddr, *addr) != 0)
     {
-        ret = DisplayList_ErrMsgSet("Could not allocate memory for display list %d bytes long copied from %08X\n", dlLen, segAddr);
+        DisplayList_ErrMsgSet("Could not record copy of display list %08X\n", segAddr);
+        return STEP_ERROR;
+    }
+    return STEP_DONE;
+}
+
+static void
+DisplayList_PopFrame (DisplayListSession* session)
+{
+    CopyFrame* frame = Vector_At(&session->frames, session->frames.limit - 1);
+
+    if (session->scratch.limit > frame->dlBase)
+        Vector_Erase(&session->scratch, frame->dlBase, session->scratch.limit - frame->dlBase);
+    if (session->patches.limit > frame->patchBase)
+        Vector_Erase(&session->patches, frame->patchBase, session->patches.limit - frame->patchBase);
+    Vector_Erase(&session->frames, session->frames.limit - 1, 1);
+}
+
+/*
+ * Copies a display list and everything it calls, depth first, using the session's frame stack
+ */
+static int
+DisplayList_CopyFrames (DisplayListSession* session, segaddr_t segAddr, segaddr_t* newSegAddr)
+{
+    Vector* frames = &session->frames;
+    size_t rootFrame = frames->limit;
+    segaddr_t addr;
+
+    if (DisplayList_PushFrame(session, segAddr) != 0)
         goto err;
+
+    while (true)
+    {
+        DL_STATS_TIME_START(t);
+        int step = DisplayList_Step(session, Vector_At(frames, frames->limit - 1), &addr);
+        DL_STATS_TIME_END(&session->stats, stepNs, t);
+
+        if (step == STEP_ERROR)
+            goto err;
+
+        if (step == STEP_CALL)
+        {
+            if (DisplayList_PushFrame(session, addr) != 0)
+                goto err;
+            continue;
+        }
+
+        DisplayList_PopFrame(session);
+        if (frames->limit == rootFrame)
+            break;
+        // the caller resumes on its G_DL and now finds the copy in the map, which does not count as reusing it
+        DL_STATS_ADD(&session->stats, numReused, -1);
     }
-    memcpy(newDl, dlVec.start, dlLen);
 
-    *newSegAddr = ZObj_ToSegment(obj2, newDl);
-    Vector_Destroy(&dlVec);
+    *newSegAddr = addr;
     DisplayList_ErrMsgClr();
     return 0;
 err:
+    // report every called display list on the way back out, innermost first
+    while (frames->limit > rootFrame)
+    {
+        if (frames->limit > rootFrame + 1)
+            DisplayList_ErrMsgStackTrace(((CopyFrame*)Vector_At(frames, frames->limit - 1))->segAddr);
+        DisplayList_PopFrame(session);
+    }
     *newSegAddr = -1;
-    Vector_Destroy(&dlVec);
+    return -1;
+}
+
+/*
+ * Starts a session copying from obj1 into obj2. Display lists are decoded straight out of the buffers of source
+ * objects, so a chunked obj1 is flattened first.
+ */
+int
+DisplayList_SessionNew (DisplayListSession* session, ZObj* obj1, ZObj* obj2)
+{
+    session->obj1 = obj1;
+    session->obj2 = obj2;
+    memset(session->segments, 0, sizeof(session->segments));
+    session->segments[obj1->segmentNumber] = obj1;
+    session->maxDepth = DISPLAYLIST_DEFAULT_MAX_DEPTH;
+    session->store = NULL;
+    session->storeObject = 0;
+    session->relocs = NULL;
+    DisplayList_DedupNew(&session->dedup, DL_DEDUP_NONE);
+    AddrMap_New(&session->dlMap);
+    Vector_New(&session->scratch, SIZEOF_GFX);
+    Vector_New(&session->frames, sizeof(CopyFrame));
+    Vector_New(&session->patches, sizeof(Reloc));
+#ifdef DL_STATS
+    DLStats_Clear(&session->stats);
+#endif
+    if (ZObj_Flatten(obj1) != 0)
+        return DisplayList_ErrMsgSet("Could not allocate memory for flattening the source object\n");
+    return 0;
+}
+
+int
+DisplayList_SessionFree (DisplayListSession* session)
+{
+    Vector_Destroy(&session->patches);
+    Vector_Destroy(&session->frames);
+    Vector_Destroy(&session->scratch);
+    AddrMap_Destroy(&session->dlMap);
+    DisplayList_DedupFree(&session->dedup);
+    return 0;
+}
+
+/*
+ * Adds a source object to the session's segment table under its segment number. Pointers into that segment are
+ * followed from then on and everything they reach is copied into obj2 like data from obj1, deduplicated against all of
+ * it. The object may be mapped or a view and must outlive the session, a chunked object is flattened.
+ */
+int
+DisplayList_SessionAddSegment (DisplayListSession* session, ZObj* obj)
+{
+    ZObj** slot = &session->segments[obj->segmentNumber];
+
+    if (*slot != NULL && *slot != obj)
+        return DisplayList_ErrMsgSet("Segment %d already has a source object\n", obj->segmentNumber);
+    if (ZObj_Flatten(obj) != 0)
+        return DisplayList_ErrMsgSet("Could not allocate memory for flattening the object of segment %d\n",
+                                     obj->segmentNumber);
+
+    *slot = obj;
+    return 0;
+}
+
+/*
+ * Adds data to obj2 unless identical data is already there, for structures built by the caller that point to what the
+ * session copied
+ */
+int
+DisplayList_SessionAddData (DisplayListSession* session, const void* data, size_t size, segaddr_t* newSegAddr)
+{
+    void* dst = ZObj_SearchDuplicate(session->obj2, data, size);
+
+    if (dst == NULL)
+    {
+        dst = ZObj_Alloc(session->obj2, size);
+        if (dst == NULL)
+            return DisplayList_ErrMsgSet("Could not allocate memory for %lu bytes\n", size);
+        memcpy(dst, data, size);
+    }
+    *newSegAddr = ZObj_ToSegment(session->obj2, dst);
+    return 0;
+}
+
+/*
+ * Records a pointer the caller patched in obj2 at wordAddr, from oldAddr in a source to what it holds now, for
+ * structures built around copies. Does nothing unless the session records relocations.
+ */
+int
+DisplayList_SessionAddReloc (DisplayListSession* session, segaddr_t wordAddr, segaddr_t oldAddr, int kind)
+{
+    const void* word = ZObj_FromSegment(session->obj2, wordAddr);
+
+    if (session->relocs == NULL)
+        return 0;
+    if (word == NULL)
+        return DisplayList_ErrMsgSet("Bad segmented address %08X for relocation\n", wordAddr);
+    return Reloc_Add(session->relocs, SEGMENT_OFFSET(wordAddr), oldAddr, READ_32_BE(word, 0), kind);
+}
+
+int
+DisplayList_SessionCopy (DisplayListSession* session, segaddr_t segAddr, segaddr_t* newSegAddr)
+{
+    int ret;
+
+    // a root may already have been copied as part of an earlier one
+    if (AddrMap_Get(&session->dlMap, segAddr, newSegAddr))
+    {
+        DL_STATS_ADD(&session->stats, numReused, 1);
+        DisplayList_ErrMsgClr();
+        return 0;
+    }
+
+    DL_STATS_TIME_START(t);
+    ret = DisplayList_CopyFrames(session, segAddr, newSegAddr);
+    DL_STATS_TIME_END(&session->stats, copyNs, t);
     return ret;
 }
+
+/*
+ * Counters for everything copied in the session so far, NULL when built without DL_STATS
+ */
+const DLStats*
+DisplayList_SessionStats (const DisplayListSession* session)
+{
+#ifdef DL_STATS
+    return &session->stats;
+#else
+    return NULL;
+#endif
+}
+
+int
+DisplayList_Copy (ZObj* obj1, segaddr_t segAddr, ZObj* obj2, segaddr_t* newSegAddr)
+{
+    DisplayListSession session;
+    int ret;
+
+    DisplayList_SessionNew(&session, obj1, obj2);
+    ret = DisplayList_SessionCopy(&session, segAddr, newSegAddr);
+    DisplayList_SessionFree(&session);
+    return ret;
+}
+
+/*
+ * Copies n items in the session with copy, called with the index and address of each. An item that fails does not stop
+ * the others, its entry in newSegAddrs is set to -1 and its error is collected into the error message, prefixed with
+ * what and its index. Returns the number of items that failed.
+ */
+int
+DisplayList_SessionCopyEach (DisplayListSession* session, const segaddr_t* segAddrs, size_t n, const char* what,
+                             DisplayListCopyFunc copy, void* arg, segaddr_t* newSegAddrs)
+{
+    char errors[DL_ERRMSG_SIZE] = { 0 };
+    int numFailed = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (copy(session, i, segAddrs[i], arg, &newSegAddrs[i]) != 0)
+        {
+            char item[48];
+
+            snprintf(item, sizeof(item), "%s %lu (%08X): ", what, i, segAddrs[i]);
+            strncat(errors, item, sizeof(errors) - strlen(errors) - 1);
+            strncat(errors, DisplayList_ErrMsg(), sizeof(errors) - strlen(errors) - 1);
+            newSegAddrs[i] = -1;
+            numFailed++;
+        }
+    }
+
+    DisplayList_ErrMsgSet("%s", errors);
+    return numFailed;
+}
+
+static int
+DisplayList_SessionCopyRoot (DisplayListSession* session, size_t i, segaddr_t segAddr, void* arg,
+                             segaddr_t* newSegAddr)
+{
+    (void)i;
+    (void)arg;
+    return DisplayList_SessionCopy(session, segAddr, newSegAddr);
+}
+
+/*
+ * Copies n root display lists in the session, see DisplayList_SessionCopyEach. Returns the number of roots that failed.
+ */
+int
+DisplayList_SessionCopyBatch (DisplayListSession* session, const segaddr_t* segAddrs, size_t n, segaddr_t* newSegAddrs)
+{
+    return DisplayList_SessionCopyEach(session, segAddrs, n, "Root", DisplayList_SessionCopyRoot, NULL, newSegAddrs);
+}
+
+/*
+ * Copies n root display lists in a session of their own, see DisplayList_SessionCopyBatch
+ */
+int
+DisplayList_CopyBatch (ZObj* obj1, const segaddr_t* segAddrs, size_t n, ZObj* obj2, segaddr_t* newSegAddrs)
+{
+    DisplayListSession session;
+    int numFailed;
+
+    DisplayList_SessionNew(&session, obj1, obj2);
+    numFailed = DisplayList_SessionCopyBatch(&session, segAddrs, n, newSegAddrs);
+    DisplayList_SessionFree(&session);
+    return numFailed;
+}
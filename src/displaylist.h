@@ -1,15 +1,164 @@
 #ifndef DISPLAYLIST_H_
 #define DISPLAYLIST_H_
 
+#include "addrmap.h"
+#include "datastore.h"
+#include "dldata.h"
+#include "dlstats.h"
+#include "errmsg.h"
+#include "macros.h"
+#include "reloc.h"
+#include "vector.h"
 #include "zobj.h"
 
+#define DISPLAYLIST_DEFAULT_MAX_DEPTH 64
+
+/*
+ * How copied display lists are deduplicated against the display lists already added to the output
+ */
+typedef enum DLDedupMode {
+    DL_DEDUP_NONE,
+    DL_DEDUP_IDENTICAL,     // reuse display lists whose commands are identical once their pointers are patched
+    DL_DEDUP_TAILS,         // also end display lists with a branch into a matching tail already in the output
+} DLDedupMode;
+
+/*
+ * Every command boundary of the display lists added to one output, by hash of the commands from there to the end
+ */
+typedef struct DisplayListDedup {
+    DLDedupMode mode;
+    // suffix hash -> element of suffixes
+    AddrMap index;
+    Vector suffixes;
+    // command offsets in the display list being added
+    Vector bounds;
+    size_t numDeduped;      // display lists not added because an identical one was found
+    size_t numTails;        // display lists ending in a branch to a shared tail
+    size_t bytesSaved;
+    uint32_t lastSize;      // bytes added by the last DisplayList_Emit, 0 if it reused an identical display list
+} DisplayListDedup;
+
+/*
+ * State shared by every display list copied from obj1 to obj2 in one session. Display lists that were already copied
+ * are looked up rather than copied again, and data is deduplicated against everything in obj2. Pointers are followed
+ * into obj1 and any other source objects added to the session's segment table, everything they reach is copied into
+ * obj2.
+ */
+typedef struct DisplayListSession {
+    ZObj* obj1;
+    ZObj* obj2;
+    // source objects by segment number, NULL for segments whose pointers are left as they are
+    ZObj* segments[NUM_SEGMENTS];
+    // source display list address -> address of its copy in obj2
+    AddrMap dlMap;
+    // commands of the display lists currently being copied, innermost last
+    Vector scratch;
+    // decoding state of the display lists currently being copied, innermost last
+    Vector frames;
+    // maximum number of nested display lists to follow, 0 for no limit
+    int maxDepth;
+    // if not NULL, vertices, textures and TLUTs newly added to obj2 are recorded here for object number storeObject
+    DataStore* store;
+    int storeObject;
+    // copied display lists are added through this, its mode is DL_DEDUP_NONE unless set otherwise
+    DisplayListDedup dedup;
+    // if not NULL, every pointer patched in obj2 is recorded here
+    RelocTable* relocs;
+    // pointers patched in the display lists currently being copied, by offset in their display list, innermost last
+    Vector patches;
+#ifdef DL_STATS
+    DLStats stats;
+#endif
+} DisplayListSession;
+
+typedef struct DisplayListRef {
+    int type;
+    segaddr_t segAddr;
+    uint32_t size;          // bytes of data, unused for display lists
+    uint32_t patchPos;      // offset in the display list of the command holding the pointer
+} DisplayListRef;
+
+/*
+ * Texture engine state needed to find what texture and TLUT loads point to. Of the tile descriptors only the parts
+ * needed to size texture loads are tracked.
+ */
+typedef struct DisplayListDecoder {
+    uint32_t lastTimgPos;   // offset in the display list of the last G_SETTIMG
+    uint32_t timgDram;
+    uint8_t timgFmt;
+    uint8_t timgSiz;
+    // last 8 commands
+    uint8_t historyPos;
+    uint8_t history[8];
+    struct {
+        uint8_t siz;
+        uint16_t lrs;
+        uint16_t lrt;
+    } tiles[8];
+    // if not NULL, pointers into any segment with an object here are references, not just those into the decoded one
+    ZObj* const* segments;
+} DisplayListDecoder;
+
 size_t
 DisplayList_Length (ZObj* obj, uint32_t segAddr);
 
+void
+DisplayList_DecoderInit (DisplayListDecoder* dec);
+
+int
+DisplayList_Decode (DisplayListDecoder* dec, ZObj* obj, segaddr_t segAddr, uint32_t pos, const uint8_t* data,
+                    DisplayListRef* ref);
+
+void
+DisplayList_DedupNew (DisplayListDedup* dedup, DLDedupMode mode);
+
+int
+DisplayList_DedupFree (DisplayListDedup* dedup);
+
+int
+DisplayList_Emit (DisplayListDedup* dedup, ZObj* obj2, const uint8_t* dl, size_t size, segaddr_t* newSegAddr);
+
+int
+DisplayList_SessionNew (DisplayListSession* session, ZObj* obj1, ZObj* obj2);
+
+int
+DisplayList_SessionFree (DisplayListSession* session);
+
+int
+DisplayList_SessionAddSegment (DisplayListSession* session, ZObj* obj);
+
+int
+DisplayList_CopyData (DisplayListSession* session, segaddr_t segAddr, size_t size, segaddr_t* newSegAddr, DLDataType type);
+
+int
+DisplayList_SessionAddData (DisplayListSession* session, const void* data, size_t size, segaddr_t* newSegAddr);
+
+int
+DisplayList_SessionAddReloc (DisplayListSession* session, segaddr_t wordAddr, segaddr_t oldAddr, int kind);
+
+int
+DisplayList_SessionCopy (DisplayListSession* session, segaddr_t segAddr, segaddr_t* newSegAddr);
+
+/*
+ * Copies the item at segAddr, the i-th of a DisplayList_SessionCopyEach batch
+ */
+typedef int (*DisplayListCopyFunc)(DisplayListSession* session, size_t i, segaddr_t segAddr, void* arg,
+                                   segaddr_t* newSegAddr);
+
+int
+DisplayList_SessionCopyEach (DisplayListSession* session, const segaddr_t* segAddrs, size_t n, const char* what,
+                             DisplayListCopyFunc copy, void* arg, segaddr_t* newSegAddrs);
+
+int
+DisplayList_SessionCopyBatch (DisplayListSession* session, const segaddr_t* segAddrs, size_t n, segaddr_t* newSegAddrs);
+
+const DLStats*
+DisplayList_SessionStats (const DisplayListSession* session);
+
 int
 DisplayList_Copy (ZObj* obj1, uint32_t segAddr, ZObj* obj2, uint32_t* newSegAddr);
 
-const char*
-DisplayList_ErrMsg (void);
+int
+DisplayList_CopyBatch (ZObj* obj1, const segaddr_t* segAddrs, size_t n, ZObj* obj2, segaddr_t* newSegAddrs);
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef DLDATA_H_
+#define DLDATA_H_
+
+/*
+ * Kinds of data copied for display lists, and for the animations copied alongside them
+ */
+typedef enum DLDataType {
+    DL_DATA_VTX,
+    DL_DATA_MTX,
+    DL_DATA_LIGHT,
+    DL_DATA_VIEWPORT,
+    DL_DATA_FORCED_MTX,
+    DL_DATA_TEXTURE,
+    DL_DATA_TLUT,
+    DL_DATA_ANIM_FRAMES,
+    DL_DATA_ANIM_JOINTS,
+    DL_DATA_MAX
+} DLDataType;
+
+/*
+ * What a display list command points to: a display list, one of the DLDataType kinds of data, or nothing
+ */
+enum {
+    DL_REF_NONE = -1,
+    DL_REF_DL = DL_DATA_MAX,
+    DL_REF_STRUCT,          // only in relocations: a structure built around copies, such as a limb or limb table
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ *  Copy session counters and their JSON report
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "dlstats.h"
+
+static const char* dl_data_type_keys[DL_DATA_MAX] = {
+    [DL_DATA_VTX]        = "vertices",
+    [DL_DATA_MTX]        = "matrix",
+    [DL_DATA_LIGHT]      = "light",
+    [DL_DATA_VIEWPORT]   = "viewport",
+    [DL_DATA_FORCED_MTX] = "forced_matrix",
+    [DL_DATA_TEXTURE]    = "texture",
+    [DL_DATA_TLUT]       = "tlut",
+    [DL_DATA_ANIM_FRAMES] = "anim_frame_data",
+    [DL_DATA_ANIM_JOINTS] = "anim_joint_indices",
+};
+
+uint64_t
+DLStats_Now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+DLStats_Clear (DLStats* stats)
+{
+    memset(stats, 0, sizeof(DLStats));
+}
+
+void
+DLStats_Add (DLStats* dst, const DLStats* src)
+{
+    dst->copyNs += src->copyNs;
+    dst->stepNs += src->stepNs;
+    dst->numDisplayLists += src->numDisplayLists;
+    dst->numReused += src->numReused;
+    dst->dlBytes += src->dlBytes;
+    if (src->maxDepth > dst->maxDepth)
+        dst->maxDepth = src->maxDepth;
+
+    for (int i = 0; i < DL_DATA_MAX; i++)
+    {
+        dst->data[i].count += src->data[i].count;
+        dst->data[i].hits += src->data[i].hits;
+        dst->data[i].bytesAllocated += src->data[i].bytesAllocated;
+        dst->data[i].bytesSaved += src->data[i].bytesSaved;
+        dst->data[i].lookupNs += src->data[i].lookupNs;
+        dst->data[i].ns += src->data[i].ns;
+    }
+}
+
+/*
+ * Writes the counters as a JSON object, every line after the first indented by indent spaces. The data totals and the
+ * decoding time with data copies taken out are derived here rather than counted.
+ */
+void
+DLStats_WriteJson (const DLStats* stats, FILE* file, int indent)
+{
+    uint64_t count = 0;
+    uint64_t hits = 0;
+    uint64_t bytesAllocated = 0;
+    uint64_t bytesSaved = 0;
+    uint64_t lookupNs = 0;
+    uint64_t dataNs = 0;
+
+    for (int i = 0; i < DL_DATA_MAX; i++)
+    {
+        count += stats->data[i].count;
+        hits += stats->data[i].hits;
+        bytesAllocated += stats->data[i].bytesAllocated;
+        bytesSaved += stats->data[i].bytesSaved;
+        lookupNs += stats->data[i].lookupNs;
+        dataNs += stats->data[i].ns;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "%*s\"copy_ns\": %lu,\n", indent + 2, "", stats->copyNs);
+    fprintf(file, "%*s\"parse_ns\": %lu,\n", indent + 2, "", stats->stepNs - dataNs);
+    fprintf(file, "%*s\"display_lists\": %lu,\n", indent + 2, "", stats->numDisplayLists);
+    fprintf(file, "%*s\"display_lists_reused\": %lu,\n", indent + 2, "", stats->numReused);
+    fprintf(file, "%*s\"display_list_bytes\": %lu,\n", indent + 2, "", stats->dlBytes);
+    fprintf(file, "%*s\"max_depth\": %lu,\n", indent + 2, "", stats->maxDepth);
+    fprintf(file, "%*s\"dedup\": { \"lookups\": %lu, \"hits\": %lu, \"misses\": %lu, \"lookup_ns\": %lu, "
+                  "\"bytes_allocated\": %lu, \"bytes_saved\": %lu },\n", indent + 2, "",
+            count, hits, count - hits, lookupNs, bytesAllocated, bytesSaved);
+    fprintf(file, "%*s\"data\": {\n", indent + 2, "");
+    for (int i = 0; i < DL_DATA_MAX; i++)
+    {
+        fprintf(file, "%*s\"%s\": { \"count\": %lu, \"hits\": %lu, \"misses\": %lu, \"bytes_allocated\": %lu, "
+                      "\"bytes_saved\": %lu, \"lookup_ns\": %lu, \"ns\": %lu }%s\n", indent + 4, "",
+                dl_data_type_keys[i], stats->data[i].count, stats->data[i].hits,
+                stats->data[i].count - stats->data[i].hits, stats->data[i].bytesAllocated, stats->data[i].bytesSaved,
+                stats->data[i].lookupNs, stats->data[i].ns, (i == DL_DATA_MAX - 1) ? "" : ",");
+    }
+    fprintf(file, "%*s}\n", indent + 2, "");
+    fprintf(file, "%*s}", indent, "");
+}
@@ -0,0 +1,65 @@
+#ifndef DLSTATS_H_
+#define DLSTATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dldata.h"
+
+/*
+ * Counters for one copy session, times are in nanoseconds. Only collected when built with DL_STATS defined, otherwise
+ * the DL_STATS_* macros expand to nothing.
+ */
+typedef struct DLStats {
+    uint64_t copyNs;            // time spent copying roots, everything below included
+    uint64_t stepNs;            // time spent decoding display lists, data copies included
+    uint64_t numDisplayLists;   // display lists copied
+    uint64_t numReused;         // display lists found already copied in the session
+    uint64_t dlBytes;           // bytes of display lists written
+    uint64_t maxDepth;          // deepest nesting of display lists
+    struct {
+        uint64_t count;         // pieces of data copied or found already present
+        uint64_t hits;          // found already present
+        uint64_t bytesAllocated;
+        uint64_t bytesSaved;    // not allocated because they were found already present
+        uint64_t lookupNs;      // time spent searching for duplicates
+        uint64_t ns;            // time spent in total
+    } data[DL_DATA_MAX];
+} DLStats;
+
+#ifdef DL_STATS
+#define DL_STATS_ENABLED 1
+
+#define DL_STATS_ADD(stats, field, n) \
+    do { (stats)->field += (n); } while (0)
+
+#define DL_STATS_MAX(stats, field, n) \
+    do { if ((uint64_t)(n) > (stats)->field) (stats)->field = (n); } while (0)
+
+#define DL_STATS_TIME_START(t) \
+    uint64_t t = DLStats_Now()
+
+#define DL_STATS_TIME_END(stats, field, t) \
+    do { (stats)->field += DLStats_Now() - (t); } while (0)
+#else
+#define DL_STATS_ENABLED 0
+
+#define DL_STATS_ADD(stats, field, n)       do { } while (0)
+#define DL_STATS_MAX(stats, field, n)       do { } while (0)
+#define DL_STATS_TIME_START(t)              do { } while (0)
+#define DL_STATS_TIME_END(stats, field, t)  do { } while (0)
+#endif
+
+uint64_t
+DLStats_Now (void);
+
+void
+DLStats_Clear (DLStats* stats);
+
+void
+DLStats_Add (DLStats* dst, const DLStats* src);
+
+void
+DLStats_WriteJson (const DLStats* stats, FILE* file, int indent);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ *  Error message of the last failed library call, one per thread
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "errmsg.h"
+
+static _Thread_local char dl_errmsg[DL_ERRMSG_SIZE];
+
+const char*
+DisplayList_ErrMsg (void)
+{
+    return dl_errmsg;
+}
+
+void
+DisplayList_ErrMsgClr (void)
+{
+    memset(dl_errmsg, 0, sizeof(dl_errmsg));
+}
+
+/*
+ * Replaces the error message, returns -1 so that failing calls can return it directly
+ */
+int
+DisplayList_ErrMsgSet (const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(dl_errmsg, sizeof(dl_errmsg), fmt, ap);
+    va_end(ap);
+
+    return -1;
+}
+
+/*
+ * Adds to the end of the error message, cutting off what does not fit
+ */
+int
+DisplayList_ErrMsgAppend (const char* fmt, ...)
+{
+    size_t len = strlen(dl_errmsg);
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(dl_errmsg + len, sizeof(dl_errmsg) - len, fmt, ap);
+    va_end(ap);
+
+    return -1;
+}
@@ -0,0 +1,20 @@
+#ifndef ERRMSG_H_
+#define ERRMSG_H_
+
+#include "macros.h"
+
+#define DL_ERRMSG_SIZE 1024
+
+const char*
+DisplayList_ErrMsg (void);
+
+void
+DisplayList_ErrMsgClr (void);
+
+int
+DisplayList_ErrMsgSet (const char* fmt, ...) PRINTF_FORMAT(1, 2);
+
+int
+DisplayList_ErrMsgAppend (const char* fmt, ...) PRINTF_FORMAT(1, 2);
+
+#endif
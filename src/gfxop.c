@@ -0,0 +1,84 @@
+/*
+ *  Descriptors of the F3DEX2 commands, shared by every pass over display lists so that they agree on command lengths
+ */
+#include "gbi.h"
+#include "gfxop.h"
+
+#define OP(len, opClass) { (len), (opClass) }
+
+const GfxOp gfx_ops[256] = {
+    /*
+     * These commands contain pointers, except G_ENDDL which is here for convenience
+     */
+    [G_DL]              = OP(SIZEOF_GFX, GFX_OP_DL),
+    [G_ENDDL]           = OP(SIZEOF_GFX, GFX_OP_ENDDL),
+    [G_MOVEMEM]         = OP(SIZEOF_GFX, GFX_OP_MOVEMEM),
+    [G_MTX]             = OP(SIZEOF_GFX, GFX_OP_MTX),
+    [G_VTX]             = OP(SIZEOF_GFX, GFX_OP_VTX),
+
+    /*
+     * Texture and TLUT Loading
+     */
+    [G_SETTIMG]         = OP(SIZEOF_GFX, GFX_OP_SETTIMG),
+    [G_SETTILE]         = OP(SIZEOF_GFX, GFX_OP_SETTILE),
+    [G_SETTILESIZE]     = OP(SIZEOF_GFX, GFX_OP_SETTILESIZE),
+    [G_LOADTLUT]        = OP(SIZEOF_GFX, GFX_OP_LOADTLUT),
+    // only used inside larger texture macros, so nothing special has to be done with them
+    [G_LOADTILE]        = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_LOADBLOCK]       = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+
+    /*
+     * These commands are 128 bits rather than the usual 64 bits
+     */
+    [G_TEXRECTFLIP]     = OP(2 * SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_TEXRECT]         = OP(2 * SIZEOF_GFX, GFX_OP_PLAIN),
+
+    /*
+     * These should not appear in objects
+     */
+    [G_MOVEWORD]        = OP(SIZEOF_GFX, GFX_OP_FORBIDDEN),
+    [G_DMA_IO]          = OP(SIZEOF_GFX, GFX_OP_FORBIDDEN),
+    [G_LOAD_UCODE]      = OP(SIZEOF_GFX, GFX_OP_FORBIDDEN),
+    [G_SETCIMG]         = OP(SIZEOF_GFX, GFX_OP_FORBIDDEN),
+    [G_SETZIMG]         = OP(SIZEOF_GFX, GFX_OP_FORBIDDEN),
+
+    /*
+     * All other valid commands do not need any special handling
+     */
+    [G_RDPHALF_2]       = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETOTHERMODE_H]  = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETOTHERMODE_L]  = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_RDPHALF_1]       = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SPNOOP]          = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_GEOMETRYMODE]    = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_POPMTX]          = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_TEXTURE]         = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SPECIAL_1]       = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SPECIAL_2]       = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SPECIAL_3]       = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_MODIFYVTX]       = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_CULLDL]          = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_BRANCH_Z]        = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_TRI1]            = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_TRI2]            = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_QUAD]            = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_LINE3D]          = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_NOOP]            = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETCOMBINE]      = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETENVCOLOR]     = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETPRIMCOLOR]    = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETBLENDCOLOR]   = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETFOGCOLOR]     = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETFILLCOLOR]    = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_FILLRECT]        = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_RDPSETOTHERMODE] = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETPRIMDEPTH]    = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETSCISSOR]      = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETCONVERT]      = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETKEYR]         = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_SETKEYGB]        = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_RDPFULLSYNC]     = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_RDPTILESYNC]     = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_RDPPIPESYNC]     = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+    [G_RDPLOADSYNC]     = OP(SIZEOF_GFX, GFX_OP_PLAIN),
+};
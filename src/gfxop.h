@@ -0,0 +1,33 @@
+#ifndef GFXOP_H_
+#define GFXOP_H_
+
+#include <stdint.h>
+
+/*
+ * What a pass over a display list has to do for a command, beyond stepping over it. Commands that carry a pointer, or
+ * state needed to find the size of what a later command points to, each have a class of their own.
+ */
+typedef enum GfxOpClass {
+    GFX_OP_INVALID = 0, // not an F3DEX2 command
+    GFX_OP_PLAIN,       // nothing to do
+    GFX_OP_FORBIDDEN,   // valid, but should not appear in objects
+    GFX_OP_DL,
+    GFX_OP_ENDDL,
+    GFX_OP_MOVEMEM,
+    GFX_OP_MTX,
+    GFX_OP_VTX,
+    GFX_OP_SETTIMG,
+    GFX_OP_SETTILE,
+    GFX_OP_SETTILESIZE,
+    GFX_OP_LOADTLUT,
+} GfxOpClass;
+
+typedef struct GfxOp {
+    uint8_t len;        // length in bytes, 0 for invalid commands
+    uint8_t opClass;    // GfxOpClass
+} GfxOp;
+
+// indexed by opcode, the top byte of w0
+extern const GfxOp gfx_ops[256];
+
+#endif
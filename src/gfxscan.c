@@ -0,0 +1,189 @@
+/*
+ *  Fast scan over display list commands that need no attention from a length pass
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GFXSCAN_X86
+#endif
+
+#include "gbi.h"
+#include "gfxop.h"
+#include "gfxscan.h"
+
+/*
+ * Commands are skipped when they are valid, 8 bytes long and do not end a display list. That leaves invalid commands,
+ * G_DL, G_ENDDL, G_TEXRECT and G_TEXRECTFLIP for the caller. The set is derived from gfx_ops once, as a byte table for
+ * the scalar scan and as a bitmap split by nibbles for the vector scans: bit (op >> 4) & 7 of rows[op >> 7][op & 15] is
+ * set for every skipped opcode.
+ */
+static bool gfxscan_skip[256];
+static uint8_t gfxscan_rows[2][16];
+static const uint8_t* (*gfxscan_func)(const uint8_t* data, const uint8_t* end);
+static pthread_once_t gfxscan_once = PTHREAD_ONCE_INIT;
+
+static const uint8_t*
+GfxScan_SkipScalar (const uint8_t* data, const uint8_t* end)
+{
+    while (end - data >= SIZEOF_GFX && gfxscan_skip[data[0]])
+        data += SIZEOF_GFX;
+    return data;
+}
+
+#ifdef GFXSCAN_X86
+
+/*
+ * Both vector scans classify every byte and then only look at the bytes that start commands. Each byte of the result is
+ * 0xFF if it is a skipped opcode.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i
+GfxScan_Classify128 (__m128i v, __m128i rowsLo, __m128i rowsHi, __m128i bits)
+{
+    __m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0F));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+    __m128i upper = _mm_cmpgt_epi8(hi, _mm_set1_epi8(7));
+    __m128i row = _mm_or_si128(_mm_and_si128(upper, _mm_shuffle_epi8(rowsHi, lo)),
+                               _mm_andnot_si128(upper, _mm_shuffle_epi8(rowsLo, lo)));
+    __m128i bit = _mm_shuffle_epi8(bits, hi);
+
+    return _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+GfxScan_Classify256 (__m256i v, __m256i rowsLo, __m256i rowsHi, __m256i bits)
+{
+    __m256i lo = _mm256_and_si256(v, _mm256_set1_epi8(0x0F));
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+    __m256i upper = _mm256_cmpgt_epi8(hi, _mm256_set1_epi8(7));
+    __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(rowsLo, lo), _mm256_shuffle_epi8(rowsHi, lo), upper);
+    __m256i bit = _mm256_shuffle_epi8(bits, hi);
+
+    return _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+}
+
+// 1 << (n & 7) for nibble n, looked up with a shuffle
+#define GFXSCAN_BITS 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+
+/*
+ * Runs of commands are checked a block at a time by packing their opcodes together first, the low byte of every 64-bit
+ * word once loaded. The commands of a block that stopped the scan are looked at again one vector at a time.
+ */
+__attribute__((target("ssse3")))
+static const uint8_t*
+GfxScan_SkipSSSE3 (const uint8_t* data, const uint8_t* end)
+{
+    const __m128i rowsLo = _mm_loadu_si128((const __m128i*)gfxscan_rows[0]);
+    const __m128i rowsHi = _mm_loadu_si128((const __m128i*)gfxscan_rows[1]);
+    const __m128i bits = _mm_setr_epi8(GFXSCAN_BITS);
+    const __m128i opMask = _mm_set1_epi64x(0xFF);
+    const __m128i* vp;
+
+    while (end - data >= 128)
+    {
+        __m128i ops[8];
+
+        vp = (const __m128i*)data;
+        for (int i = 0; i < 8; i++)
+            ops[i] = _mm_and_si128(_mm_loadu_si128(vp + i), opMask);
+        for (int i = 0; i < 4; i++)
+            ops[i] = _mm_packs_epi32(ops[2 * i], ops[2 * i + 1]);
+        ops[0] = _mm_packs_epi32(ops[0], ops[1]);
+        ops[1] = _mm_packs_epi32(ops[2], ops[3]);
+        ops[0] = _mm_packus_epi16(ops[0], ops[1]);
+
+        if (_mm_movemask_epi8(GfxScan_Classify128(ops[0], rowsLo, rowsHi, bits)) != 0xFFFF)
+            break;
+        data += 128;
+    }
+    while (end - data >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)data);
+        uint32_t stop = ~_mm_movemask_epi8(GfxScan_Classify128(v, rowsLo, rowsHi, bits)) & 0x0101;
+
+        if (stop != 0)
+            return data + __builtin_ctz(stop);
+        data += 16;
+    }
+    return GfxScan_SkipScalar(data, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t*
+GfxScan_SkipAVX2 (const uint8_t* data, const uint8_t* end)
+{
+    const __m256i rowsLo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gfxscan_rows[0]));
+    const __m256i rowsHi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)gfxscan_rows[1]));
+    const __m256i bits = _mm256_setr_epi8(GFXSCAN_BITS, GFXSCAN_BITS);
+    const __m256i opMask = _mm256_set1_epi64x(0xFF);
+    const __m256i* vp;
+
+    while (end - data >= 256)
+    {
+        __m256i ops[8];
+
+        vp = (const __m256i*)data;
+        for (int i = 0; i < 8; i++)
+            ops[i] = _mm256_and_si256(_mm256_loadu_si256(vp + i), opMask);
+        for (int i = 0; i < 4; i++)
+            ops[i] = _mm256_packus_epi32(ops[2 * i], ops[2 * i + 1]);
+        ops[0] = _mm256_packus_epi32(ops[0], ops[1]);
+        ops[1] = _mm256_packus_epi32(ops[2], ops[3]);
+        ops[0] = _mm256_packus_epi16(ops[0], ops[1]);
+
+        if ((uint32_t)_mm256_movemask_epi8(GfxScan_Classify256(ops[0], rowsLo, rowsHi, bits)) != 0xFFFFFFFF)
+            break;
+        data += 256;
+    }
+    while (end - data >= 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)data);
+        uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(GfxScan_Classify256(v, rowsLo, rowsHi, bits)) & 0x01010101;
+
+        if (stop != 0)
+            return data + __builtin_ctz(stop);
+        data += 32;
+    }
+    return GfxScan_SkipScalar(data, end);
+}
+
+#endif
+
+static void
+GfxScan_Init (void)
+{
+    for (int op = 0; op < 256; op++)
+    {
+        gfxscan_skip[op] = gfx_ops[op].len == SIZEOF_GFX &&
+                           gfx_ops[op].opClass != GFX_OP_INVALID &&
+                           gfx_ops[op].opClass != GFX_OP_DL &&
+                           gfx_ops[op].opClass != GFX_OP_ENDDL;
+        if (gfxscan_skip[op])
+            gfxscan_rows[op >> 7][op & 15] |= 1 << ((op >> 4) & 7);
+    }
+
+    gfxscan_func = GfxScan_SkipScalar;
+#ifdef GFXSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        gfxscan_func = GfxScan_SkipAVX2;
+    else if (__builtin_cpu_supports("ssse3"))
+        gfxscan_func = GfxScan_SkipSSSE3;
+#endif
+}
+
+/*
+ * Returns the first command from data on that a length pass has to look at, or the first position less than a command
+ * from end. data must be at the start of a command.
+ */
+const uint8_t*
+GfxScan_Skip (const uint8_t* data, const uint8_t* end)
+{
+    pthread_once(&gfxscan_once, GfxScan_Init);
+    return gfxscan_func(data, end);
+}
@@ -0,0 +1,9 @@
+#ifndef GFXSCAN_H_
+#define GFXSCAN_H_
+
+#include <stdint.h>
+
+const uint8_t*
+GfxScan_Skip (const uint8_t* data, const uint8_t* end);
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ *  Helpers for the JSON reports written by zobjcopy
+ */
+#include <stdio.h>
+
+#include "json.h"
+
+/*
+ * Writes a string as a JSON string, for the names of files in reports
+ */
+void
+Json_WriteString (FILE* file, const char* str)
+{
+    fputc('"', file);
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', file);
+        fputc(*str, file);
+    }
+    fputc('"', file);
+}
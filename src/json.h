@@ -0,0 +1,9 @@
+#ifndef JSON_H_
+#define JSON_H_
+
+#include <stdio.h>
+
+void
+Json_WriteString (FILE* file, const char* str);
+
+#endif
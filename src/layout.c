@@ -0,0 +1,274 @@
+/*
+ *  Output layout that groups what display lists point to by type, in the order it is first used
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "displaylist.h"
+#include "refgraph.h"
+#include "layout.h"
+
+/*
+ * Regions of the laid out object, in order
+ */
+enum {
+    LAYOUT_TEXTURES,    // textures and TLUTs
+    LAYOUT_VERTICES,
+    LAYOUT_OTHER,       // matrices, lights and viewports
+    LAYOUT_DISPLAY_LISTS,
+};
+
+/*
+ * Bytes of the object moved as one piece. Display lists or data that overlap, because a copy found them already in the
+ * object, stay overlapping.
+ */
+typedef struct LayoutExtent {
+    segaddr_t start;
+    segaddr_t end;
+    uint32_t firstUse;
+    int region;
+    uint32_t index;         // position before the extents are put in layout order
+    segaddr_t newSegAddr;
+} LayoutExtent;
+
+typedef struct LayoutItem {
+    segaddr_t start;
+    segaddr_t end;
+    uint32_t node;
+    bool isDL;
+} LayoutItem;
+
+static int
+Layout_Region (int type)
+{
+    switch (type)
+    {
+        case DL_REF_DL:
+            return LAYOUT_DISPLAY_LISTS;
+        case DL_DATA_TEXTURE:
+        case DL_DATA_TLUT:
+            return LAYOUT_TEXTURES;
+        case DL_DATA_VTX:
+            return LAYOUT_VERTICES;
+        default:
+            return LAYOUT_OTHER;
+    }
+}
+
+/*
+ * Display lists are only merged with display lists and data with data, the pointers in a display list change when it
+ * is moved while data that happened to match its bytes must not
+ */
+static int
+Layout_CompareItems (const void* a, const void* b)
+{
+    const LayoutItem* itemA = a;
+    const LayoutItem* itemB = b;
+
+    if (itemA->isDL != itemB->isDL)
+        return itemA->isDL - itemB->isDL;
+    if (itemA->start != itemB->start)
+        return (itemA->start > itemB->start) ? 1 : -1;
+    return (itemA->end > itemB->end) - (itemA->end < itemB->end);
+}
+
+static int
+Layout_CompareExtents (const void* a, const void* b)
+{
+    const LayoutExtent* extentA = a;
+    const LayoutExtent* extentB = b;
+
+    if (extentA->region != extentB->region)
+        return extentA->region - extentB->region;
+    if (extentA->firstUse != extentB->firstUse)
+        return (extentA->firstUse > extentB->firstUse) ? 1 : -1;
+    return (extentA->start > extentB->start) - (extentA->start < extentB->start);
+}
+
+static segaddr_t
+Layout_NewAddr (const RefGraph* graph, const LayoutExtent* extents, const uint32_t* extentOf, uint32_t node)
+{
+    const LayoutExtent* extent = &extents[extentOf[node]];
+
+    return extent->newSegAddr + (((const RefNode*)graph->nodes.start)[node].segAddr - extent->start);
+}
+
+/*
+ * Numbers every node in the order a depth first walk from the roots, following pointers in command order, first
+ * meets it
+ */
+static int
+Layout_FirstUse (RefGraph* graph, const uint32_t* roots, size_t n, uint32_t* firstUse)
+{
+    size_t numNodes = graph->nodes.limit;
+    uint32_t* stack = malloc((numNodes + 1) * 2 * sizeof(uint32_t));
+    uint32_t count = 0;
+
+    if (stack == NULL)
+        return -1;
+    memset(firstUse, 0xFF, numNodes * sizeof(uint32_t));
+
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t top = 0;
+
+        if (firstUse[roots[i]] != REFGRAPH_NONE)
+            continue;
+        firstUse[roots[i]] = count++;
+        stack[top++] = roots[i];
+        stack[top++] = 0;
+
+        // pairs of node and next edge, every node is pushed at most once
+        while (top != 0)
+        {
+            const RefNode* node = (const RefNode*)graph->nodes.start + stack[top - 2];
+            uint32_t edge = stack[top - 1];
+
+            if (edge == node->numEdges)
+            {
+                top -= 2;
+                continue;
+            }
+            stack[top - 1]++;
+
+            uint32_t target = ((const RefEdge*)graph->edges.start)[node->firstEdge + edge].target;
+            if (firstUse[target] != REFGRAPH_NONE)
+                continue;
+            firstUse[target] = count++;
+            if (((const RefNode*)graph->nodes.start)[target].numEdges != 0)
+            {
+                stack[top++] = target;
+                stack[top++] = 0;
+            }
+        }
+    }
+    free(stack);
+    return 0;
+}
+
+/*
+ * Lays out obj, usually an object display lists were copied into, into out: textures and TLUTs first, then vertices,
+ * then other data and then the display lists, each in the order the roots first use them. Every pointer is moved with
+ * what it points to and newSegAddrs receives the new addresses of the roots. Only what the roots reach is kept. The
+ * layout only depends on the contents of obj and the roots. A chunked obj is flattened first.
+ */
+int
+Layout_Optimize (ZObj* obj, const segaddr_t* segAddrs, size_t n, ZObj* out, segaddr_t* newSegAddrs)
+{
+    RefGraph graph;
+    uint32_t* roots = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* firstUse = NULL;
+    uint32_t* extentOf = NULL;
+    LayoutItem* items = NULL;
+    LayoutExtent* extents = NULL;
+    size_t numExtents = 0;
+    int ret = -1;
+
+    RefGraph_New(&graph, obj);
+    if (roots == NULL || ZObj_Flatten(obj) != 0)
+    {
+        DisplayList_ErrMsgSet("Could not allocate memory for laying out %lu roots\n", n);
+        goto end;
+    }
+    if (RefGraph_Build(&graph, segAddrs, n, roots) != 0)
+        goto end;
+
+    size_t numNodes = graph.nodes.limit;
+    firstUse = malloc((numNodes + 1) * sizeof(uint32_t));
+    extentOf = malloc((numNodes + 1) * sizeof(uint32_t));
+    items = malloc((numNodes + 1) * sizeof(LayoutItem));
+    extents = malloc((numNodes + 1) * sizeof(LayoutExtent));
+    if (firstUse == NULL || extentOf == NULL || items == NULL || extents == NULL ||
+        Layout_FirstUse(&graph, roots, n, firstUse) != 0)
+    {
+        DisplayList_ErrMsgSet("Could not allocate memory for laying out %lu graph nodes\n", numNodes);
+        goto end;
+    }
+
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        const RefNode* node = (const RefNode*)graph.nodes.start + i;
+
+        items[i].start = node->segAddr;
+        items[i].end = node->segAddr + node->size;
+        items[i].node = i;
+        items[i].isDL = (node->type == DL_REF_DL);
+    }
+    qsort(items, numNodes, sizeof(LayoutItem), Layout_CompareItems);
+
+    // merge overlapping nodes into extents, an extent goes in the earliest region and at the first use of any of them
+    for (size_t i = 0; i < numNodes;)
+    {
+        LayoutExtent* extent = &extents[numExtents];
+        size_t j = i;
+
+        extent->start = items[i].start;
+        extent->end = items[i].end;
+        extent->firstUse = REFGRAPH_NONE;
+        extent->region = LAYOUT_DISPLAY_LISTS;
+        // the first node always starts the extent, even if it holds no bytes
+        for (; j < numNodes && items[j].isDL == items[i].isDL && (j == i || items[j].start < extent->end); j++)
+        {
+            const RefNode* node = (const RefNode*)graph.nodes.start + items[j].node;
+
+            if (items[j].end > extent->end)
+                extent->end = items[j].end;
+            if (firstUse[items[j].node] < extent->firstUse)
+                extent->firstUse = firstUse[items[j].node];
+            if (Layout_Region(node->type) < extent->region)
+                extent->region = Layout_Region(node->type);
+            extentOf[items[j].node] = numExtents;
+        }
+        numExtents++;
+        i = j;
+    }
+
+    // put the extents in layout order and point the nodes at their new positions, items is reused to map them
+    for (size_t i = 0; i < numExtents; i++)
+        extents[i].index = i;
+    qsort(extents, numExtents, sizeof(LayoutExtent), Layout_CompareExtents);
+    for (size_t i = 0; i < numExtents; i++)
+        items[extents[i].index].node = i;
+    for (uint32_t i = 0; i < numNodes; i++)
+        extentOf[i] = items[extentOf[i]].node;
+
+    for (size_t i = 0; i < numExtents; i++)
+    {
+        LayoutExtent* extent = &extents[i];
+        void* dst = ZObj_Alloc(out, extent->end - extent->start);
+
+        if (dst == NULL)
+        {
+            DisplayList_ErrMsgSet("Could not allocate memory for %u bytes laid out from %08X\n",
+                                  extent->end - extent->start, extent->start);
+            goto end;
+        }
+        memcpy(dst, ZObj_FromSegment(obj, extent->start), extent->end - extent->start);
+        extent->newSegAddr = ZObj_ToSegment(out, dst);
+    }
+
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        const RefNode* node = (const RefNode*)graph.nodes.start + i;
+        const RefEdge* edges = (const RefEdge*)graph.edges.start + node->firstEdge;
+        uint8_t* dl = ZObj_FromSegment(out, Layout_NewAddr(&graph, extents, extentOf, i));
+
+        for (uint32_t j = 0; j < node->numEdges; j++)
+            WRITE_32_BE(dl, edges[j].patchPos + 4, Layout_NewAddr(&graph, extents, extentOf, edges[j].target));
+    }
+    for (size_t i = 0; i < n; i++)
+        newSegAddrs[i] = Layout_NewAddr(&graph, extents, extentOf, roots[i]);
+
+    ret = 0;
+end:
+    RefGraph_Free(&graph);
+    free(extents);
+    free(items);
+    free(extentOf);
+    free(firstUse);
+    free(roots);
+    return ret;
+}
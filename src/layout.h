@@ -0,0 +1,11 @@
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include <stddef.h>
+
+#include "zobj.h"
+
+int
+Layout_Optimize (ZObj* obj, const segaddr_t* segAddrs, size_t n, ZObj* out, segaddr_t* newSegAddrs);
+
+#endif
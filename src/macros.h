@@ -7,6 +7,7 @@
 
 #define NORETURN __attribute__((noreturn))
 #define FALLTHROUGH __attribute__((fallthrough))
+#define PRINTF_FORMAT(fmt, args) __attribute__((format(printf, fmt, args)))
 
 #define ARRLEN(x) (sizeof(x) / sizeof(*(x)))
 
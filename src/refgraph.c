@@ -0,0 +1,815 @@
+/*
+ *  Reference graph of the display lists in an object, for copying subsets of them many times
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "gbi.h"
+#include "gfxop.h"
+#include "displaylist.h"
+#include "refgraph.h"
+
+typedef struct RefCopyFrame {
+    uint32_t node;
+    uint32_t edge;          // next edge to copy
+} RefCopyFrame;
+
+/*
+ * Vertices from overlapping ranges of the source, copied once as a whole
+ */
+typedef struct RefVtxGroup {
+    segaddr_t segAddr;
+    uint32_t size;
+    segaddr_t newSegAddr;   // -1 until copied
+} RefVtxGroup;
+
+/*
+ * State of one RefGraph_CopyIncremental
+ */
+typedef struct RefCopy {
+    ZObj* obj2;
+    segaddr_t* newAddrs;    // copy of every node, -1 for nodes not copied yet
+    RefMemo* memo;          // may be NULL
+    uint64_t* hashes;       // hash of every node, NULL without a memo
+    uint32_t* vtxGroups;    // group of every node, REFGRAPH_NONE if it has none, NULL unless coalescing vertices
+    RefVtxGroup* groups;
+    DisplayListDedup dedup;
+    // display list being patched
+    Vector dl;
+} RefCopy;
+
+/*
+ * Starts an empty graph of obj. Display lists are decoded straight out of the object's buffer, so a chunked obj is
+ * flattened first.
+ */
+int
+RefGraph_New (RefGraph* graph, ZObj* obj)
+{
+    graph->obj = obj;
+    graph->maxDepth = DISPLAYLIST_DEFAULT_MAX_DEPTH;
+    graph->coalesceVtx = false;
+    graph->dedupMode = DL_DEDUP_NONE;
+    Vector_New(&graph->nodes, sizeof(RefNode));
+    Vector_New(&graph->edges, sizeof(RefEdge));
+    AddrMap_New(&graph->dlNodes);
+    AddrMap_New(&graph->dataNodes);
+    Vector_New(&graph->pending, sizeof(uint32_t));
+    Vector_New(&graph->frames, sizeof(RefCopyFrame));
+    if (ZObj_Flatten(obj) != 0)
+        return DisplayList_ErrMsgSet("Could not allocate memory for flattening the object of the graph\n");
+    return 0;
+}
+
+int
+RefGraph_Free (RefGraph* graph)
+{
+    Vector_Destroy(&graph->frames);
+    Vector_Destroy(&graph->pending);
+    AddrMap_Destroy(&graph->dataNodes);
+    AddrMap_Destroy(&graph->dlNodes);
+    Vector_Destroy(&graph->edges);
+    Vector_Destroy(&graph->nodes);
+    return 0;
+}
+
+static inline RefNode*
+RefGraph_Node (RefGraph* graph, uint32_t node)
+{
+    return (RefNode*)graph->nodes.start + node;
+}
+
+static int
+RefGraph_NewNode (RefGraph* graph, segaddr_t segAddr, uint32_t size, int type, uint32_t* node)
+{
+    RefNode* new = Vector_PushBack(&graph->nodes, 1, NULL);
+
+    if (new == NULL)
+        return DisplayList_ErrMsgSet("Could not allocate memory for reference graph node for %08X\n", segAddr);
+
+    *node = graph->nodes.limit - 1;
+    new->segAddr = segAddr;
+    new->size = size;
+    new->firstEdge = 0;
+    new->numEdges = 0;
+    new->next = REFGRAPH_NONE;
+    new->type = type;
+    return 0;
+}
+
+/*
+ * Finds the node for a display list, adding it to be decoded if it is new
+ */
+static int
+RefGraph_DisplayList (RefGraph* graph, segaddr_t segAddr, uint32_t* node)
+{
+    size_t size;
+
+    if (AddrMap_Get(&graph->dlNodes, segAddr, node))
+        return 0;
+
+    size = DisplayList_Length(graph->obj, segAddr);
+    if (size == (size_t)-1)
+        return -1;
+
+    if (RefGraph_NewNode(graph, segAddr, size, DL_REF_DL, node) != 0)
+        return -1;
+    if (AddrMap_Set(&graph->dlNodes, segAddr, *node) != 0 || Vector_PushBack(&graph->pending, 1, node) == NULL)
+        return DisplayList_ErrMsgSet("Could not allocate memory for reference graph node for %08X\n", segAddr);
+    return 0;
+}
+
+/*
+ * Finds the node for a piece of data, adding it if it is new
+ */
+static int
+RefGraph_Data (RefGraph* graph, segaddr_t segAddr, uint32_t size, int type, uint32_t* node)
+{
+    ZObj* obj = graph->obj;
+    uint32_t head = REFGRAPH_NONE;
+
+    if (AddrMap_Get(&graph->dataNodes, segAddr, &head))
+    {
+        for (*node = head; *node != REFGRAPH_NONE; *node = RefGraph_Node(graph, *node)->next)
+        {
+            if (RefGraph_Node(graph, *node)->size == size)
+                return 0;
+        }
+    }
+
+    if (ZObj_FromSegment(obj, segAddr) == NULL || size > obj->limit - SEGMENT_OFFSET(segAddr))
+        return DisplayList_ErrMsgSet("Bad segmented address 0x%08X for object of size 0x%lX\n", segAddr, obj->limit);
+
+    if (RefGraph_NewNode(graph, segAddr, size, type, node) != 0)
+        return -1;
+    RefGraph_Node(graph, *node)->next = head;
+    if (AddrMap_Set(&graph->dataNodes, segAddr, *node) != 0)
+        return DisplayList_ErrMsgSet("Could not allocate memory for reference graph node for %08X\n", segAddr);
+    return 0;
+}
+
+/*
+ * Decodes a display list node into its edges
+ */
+static int
+RefGraph_Decode (RefGraph* graph, uint32_t node)
+{
+    RefNode* dl = RefGraph_Node(graph, node);
+    segaddr_t segAddr = dl->segAddr;
+    uint32_t size = dl->size;
+    const uint8_t* data = ZObj_FromSegment(graph->obj, segAddr);
+    uint32_t firstEdge = graph->edges.limit;
+    DisplayListDecoder dec;
+
+    DisplayList_DecoderInit(&dec);
+
+    for (uint32_t pos = 0; pos < size; pos += gfx_ops[data[pos]].len)
+    {
+        DisplayListRef ref;
+        RefEdge edge;
+
+        if (DisplayList_Decode(&dec, graph->obj, segAddr, pos, data + pos, &ref) != 0)
+            return -1;
+        if (ref.type == DL_REF_NONE)
+            continue;
+
+        if (ref.type == DL_REF_DL)
+        {
+            if (RefGraph_DisplayList(graph, ref.segAddr, &edge.target) != 0)
+                return -1;
+        }
+        else
+        {
+            if (RefGraph_Data(graph, ref.segAddr, ref.size, ref.type, &edge.target) != 0)
+                return -1;
+        }
+        edge.patchPos = ref.patchPos;
+        if (Vector_PushBack(&graph->edges, 1, &edge) == NULL)
+            return DisplayList_ErrMsgSet("Could not allocate memory for reference graph edge in %08X\n", segAddr);
+    }
+
+    dl = RefGraph_Node(graph, node);
+    dl->firstEdge = firstEdge;
+    dl->numEdges = graph->edges.limit - firstEdge;
+    return 0;
+}
+
+/*
+ * Drops every node and edge past the given counts, after a display list could not be added
+ */
+static void
+RefGraph_Truncate (RefGraph* graph, size_t numNodes, size_t numEdges)
+{
+    Vector_Erase(&graph->nodes, numNodes, graph->nodes.limit - numNodes);
+    Vector_Erase(&graph->edges, numEdges, graph->edges.limit - numEdges);
+    Vector_Clear(&graph->pending);
+
+    // newer data nodes only ever point at older ones, so the chains of the nodes kept are still whole
+    AddrMap_Clear(&graph->dlNodes);
+    AddrMap_Clear(&graph->dataNodes);
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        RefNode* node = RefGraph_Node(graph, i);
+
+        AddrMap_Set((node->type == DL_REF_DL) ? &graph->dlNodes : &graph->dataNodes, node->segAddr, i);
+    }
+}
+
+/*
+ * Adds a display list and everything reachable from it to the graph. On failure the graph is left as it was.
+ */
+int
+RefGraph_Add (RefGraph* graph, segaddr_t segAddr, uint32_t* node)
+{
+    size_t numNodes = graph->nodes.limit;
+    size_t numEdges = graph->edges.limit;
+
+    if (RefGraph_DisplayList(graph, segAddr, node) != 0)
+        goto err;
+
+    while (graph->pending.limit != 0)
+    {
+        uint32_t next = *(uint32_t*)Vector_At(&graph->pending, graph->pending.limit - 1);
+
+        Vector_Erase(&graph->pending, graph->pending.limit - 1, 1);
+        if (RefGraph_Decode(graph, next) != 0)
+            goto err;
+    }
+
+    DisplayList_ErrMsgSet("%s", "");
+    return 0;
+err:
+    RefGraph_Truncate(graph, numNodes, numEdges);
+    *node = REFGRAPH_NONE;
+    return -1;
+}
+
+static void
+RefGraph_RootError (char* errors, size_t size, size_t i, segaddr_t segAddr)
+{
+    char root[40];
+
+    snprintf(root, sizeof(root), "Root %lu (%08X): ", i, segAddr);
+    strncat(errors, root, size - strlen(errors) - 1);
+    strncat(errors, DisplayList_ErrMsg(), size - strlen(errors) - 1);
+}
+
+/*
+ * Adds n root display lists to the graph, their nodes are written to nodes if it is not NULL. A root that fails does
+ * not stop the others, its node is set to REFGRAPH_NONE and its error is collected into the error message. Returns the
+ * number of roots that failed.
+ */
+int
+RefGraph_Build (RefGraph* graph, const segaddr_t* segAddrs, size_t n, uint32_t* nodes)
+{
+    char errors[1024] = { 0 };
+    int numFailed = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t node;
+
+        if (RefGraph_Add(graph, segAddrs[i], &node) != 0)
+        {
+            RefGraph_RootError(errors, sizeof(errors), i, segAddrs[i]);
+            numFailed++;
+        }
+        if (nodes != NULL)
+            nodes[i] = node;
+    }
+
+    DisplayList_ErrMsgSet("%s", errors);
+    return numFailed;
+}
+
+static int
+RefGraph_CopyData (RefGraph* graph, const RefNode* node, ZObj* obj2, segaddr_t* newSegAddr)
+{
+    void* src = ZObj_FromSegment(graph->obj, node->segAddr);
+    void* dst = ZObj_SearchDuplicate(obj2, src, node->size);
+
+    if (dst == NULL)
+    {
+        dst = ZObj_Alloc(obj2, node->size);
+        if (dst == NULL)
+            return DisplayList_ErrMsgSet("Could not allocate memory for %u bytes copied from %08X\n", node->size, node->segAddr);
+        memcpy(dst, src, node->size);
+    }
+    *newSegAddr = ZObj_ToSegment(obj2, dst);
+    return 0;
+}
+
+/*
+ * Copies a display list node once every node it points to has been copied
+ */
+static int
+RefGraph_CopyDisplayList (RefGraph* graph, RefCopy* copy, const RefNode* node)
+{
+    const RefEdge* edges = (const RefEdge*)graph->edges.start + node->firstEdge;
+    uint8_t* dl;
+
+    Vector_Clear(&copy->dl);
+    dl = Vector_PushBack(&copy->dl, node->size / SIZEOF_GFX, ZObj_FromSegment(graph->obj, node->segAddr));
+    if (dl == NULL)
+        return DisplayList_ErrMsgSet("Could not allocate memory for display list %u bytes long copied from %08X\n", node->size, node->segAddr);
+
+    for (uint32_t i = 0; i < node->numEdges; i++)
+        WRITE_32_BE(dl, edges[i].patchPos + 4, copy->newAddrs[edges[i].target]);
+
+    if (DisplayList_Emit(&copy->dedup, copy->obj2, dl, node->size, &copy->newAddrs[node - (RefNode*)graph->nodes.start]) != 0)
+        return DisplayList_ErrMsgSet("Could not allocate memory for display list %u bytes long copied from %08X\n", node->size, node->segAddr);
+    return 0;
+}
+
+/*
+ * Hashes a run of bytes into hash, never returning 0
+ */
+static uint64_t
+RefGraph_HashBytes (uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* p = data;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 0x100000001B3ULL;
+    hash ^= hash >> 32;
+    return (hash == 0) ? 1 : hash;
+}
+
+static uint64_t
+RefGraph_HashWord (uint64_t hash, uint64_t word)
+{
+    return RefGraph_HashBytes(hash, &word, sizeof(word));
+}
+
+/*
+ * Hashes every node with everything it reaches: data by its contents, display lists by their own bytes and the hashes
+ * of what their edges point to. Display lists that reach a cycle get 0 and are never reused.
+ */
+static int
+RefGraph_Hash (RefGraph* graph, uint64_t* hashes)
+{
+    Vector* frames = &graph->frames;
+    size_t numNodes = graph->nodes.limit;
+    uint8_t* visited = calloc(numNodes, 1);
+
+    if (visited == NULL)
+        return DisplayList_ErrMsgSet("Could not allocate memory for hashing %lu graph nodes\n", numNodes);
+    memset(hashes, 0, numNodes * sizeof(uint64_t));
+
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        if (visited[i] || RefGraph_Node(graph, i)->type != DL_REF_DL)
+            continue;
+
+        Vector_Clear(frames);
+        RefCopyFrame start = { i, 0 };
+        if (Vector_PushBack(frames, 1, &start) == NULL)
+            goto nomem;
+        visited[i] = true;
+
+        while (frames->limit != 0)
+        {
+            RefCopyFrame* frame = Vector_At(frames, frames->limit - 1);
+            const RefNode* node = RefGraph_Node(graph, frame->node);
+
+            if (frame->edge < node->numEdges)
+            {
+                const RefEdge* edge = (const RefEdge*)graph->edges.start + node->firstEdge + frame->edge;
+                const RefNode* target = RefGraph_Node(graph, edge->target);
+
+                if (!visited[edge->target])
+                {
+                    visited[edge->target] = true;
+                    if (target->type == DL_REF_DL)
+                    {
+                        RefCopyFrame next = { edge->target, 0 };
+                        if (Vector_PushBack(frames, 1, &next) == NULL)
+                            goto nomem;
+                        continue;
+                    }
+                    hashes[edge->target] = RefGraph_HashBytes(RefGraph_HashWord(0xCBF29CE484222325ULL, target->size),
+                                                              ZObj_FromSegment(graph->obj, target->segAddr),
+                                                              target->size);
+                }
+                frame->edge++;
+                continue;
+            }
+
+            // a display list still being hashed further up has no hash yet, which marks everything in its cycle
+            const RefEdge* edges = (const RefEdge*)graph->edges.start + node->firstEdge;
+            uint64_t hash = RefGraph_HashBytes(0xCBF29CE484222325ULL, ZObj_FromSegment(graph->obj, node->segAddr),
+                                               node->size);
+            for (uint32_t j = 0; j < node->numEdges && hash != 0; j++)
+            {
+                if (hashes[edges[j].target] == 0)
+                    hash = 0;
+                else
+                    hash = RefGraph_HashWord(RefGraph_HashWord(hash, edges[j].patchPos), hashes[edges[j].target]);
+            }
+            hashes[frame->node] = hash;
+            Vector_Erase(frames, frames->limit - 1, 1);
+        }
+    }
+
+    free(visited);
+    return 0;
+nomem:
+    free(visited);
+    return DisplayList_ErrMsgSet("Could not allocate memory for hashing %lu graph nodes\n", numNodes);
+}
+
+int
+RefMemo_New (RefMemo* memo)
+{
+    AddrMap_New(&memo->index);
+    Vector_New(&memo->entries, sizeof(RefMemoEntry));
+    memo->numReused = memo->numCopied = 0;
+    return 0;
+}
+
+int
+RefMemo_Free (RefMemo* memo)
+{
+    Vector_Destroy(&memo->entries);
+    AddrMap_Destroy(&memo->index);
+    return 0;
+}
+
+static int
+RefMemo_Set (RefMemo* memo, segaddr_t segAddr, segaddr_t newSegAddr, uint64_t hash)
+{
+    RefMemoEntry entry = { segAddr, newSegAddr, hash };
+    uint32_t i;
+
+    if (AddrMap_Get(&memo->index, segAddr, &i))
+    {
+        *(RefMemoEntry*)Vector_At(&memo->entries, i) = entry;
+        return 0;
+    }
+    if (Vector_PushBack(&memo->entries, 1, &entry) == NULL ||
+        AddrMap_Set(&memo->index, segAddr, memo->entries.limit - 1) != 0)
+        return DisplayList_ErrMsgSet("Could not record copy of display list %08X\n", segAddr);
+    return 0;
+}
+
+#define MEMO_FILE_MAGIC 0x314F4D454D5A00ULL  // "\0ZMEMO1"
+
+/*
+ * Loads the memo and the duplicate index of obj2 saved by RefMemo_Write, after reading obj2 back from the file it was
+ * written to. Fails with an empty memo if the file is missing or was saved for different output, obj2 is then indexed
+ * on first search and everything is copied again.
+ */
+int
+RefMemo_Read (RefMemo* memo, ZObj* obj2, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    uint64_t header[2];
+
+    if (file == NULL)
+        return -1;
+
+    if (ZObj_ReadIndex(obj2, file) != 0 || fread(header, sizeof(header), 1, file) != 1 || header[0] != MEMO_FILE_MAGIC)
+        goto bad;
+
+    for (uint64_t i = 0; i < header[1]; i++)
+    {
+        RefMemoEntry entry;
+
+        if (fread(&entry, sizeof(entry), 1, file) != 1 || ZObj_FromSegment(obj2, entry.newSegAddr) == NULL ||
+            RefMemo_Set(memo, entry.segAddr, entry.newSegAddr, entry.hash) != 0)
+            goto bad;
+    }
+    fclose(file);
+    return 0;
+bad:
+    fclose(file);
+    Vector_Clear(&memo->entries);
+    AddrMap_Clear(&memo->index);
+    return -1;
+}
+
+/*
+ * Saves the memo along with the duplicate index of obj2, to go next to obj2 once it is written out
+ */
+int
+RefMemo_Write (const RefMemo* memo, ZObj* obj2, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    uint64_t header[2] = { MEMO_FILE_MAGIC, memo->entries.limit };
+    int ret = 0;
+
+    if (file == NULL)
+        return -1;
+
+    if (ZObj_WriteIndex(obj2, file) != 0 || fwrite(header, sizeof(header), 1, file) != 1 ||
+        fwrite(memo->entries.start, sizeof(RefMemoEntry), memo->entries.limit, file) != memo->entries.limit)
+        ret = -1;
+    if (fclose(file) != 0)
+        ret = -1;
+    return ret;
+}
+
+/*
+ * Looks for an earlier copy of a display list to reuse instead of copying it
+ */
+static bool
+RefMemo_Reuse (RefMemo* memo, const RefNode* node, uint64_t hash, segaddr_t* newSegAddr)
+{
+    uint32_t i;
+
+    if (memo == NULL || hash == 0 || !AddrMap_Get(&memo->index, node->segAddr, &i))
+        return false;
+
+    const RefMemoEntry* entry = Vector_At(&memo->entries, i);
+    if (entry->hash != hash)
+        return false;
+
+    *newSegAddr = entry->newSegAddr;
+    memo->numReused++;
+    return true;
+}
+
+typedef struct RefVtxRange {
+    segaddr_t start;
+    segaddr_t end;
+    uint32_t node;
+} RefVtxRange;
+
+static int
+RefGraph_CompareVtxRanges (const void* a, const void* b)
+{
+    const RefVtxRange* rangeA = a;
+    const RefVtxRange* rangeB = b;
+
+    if (rangeA->start != rangeB->start)
+        return (rangeA->start > rangeB->start) ? 1 : -1;
+    return (rangeA->end > rangeB->end) - (rangeA->end < rangeB->end);
+}
+
+/*
+ * Groups the vertex nodes reachable from the roots whose source ranges overlap, so that each group is copied as one
+ * run of vertices and every G_VTX into it points at an offset in that run. Vertices overlapping no others are left to
+ * be deduplicated one by one.
+ */
+static int
+RefGraph_PlanVertices (RefGraph* graph, const uint32_t* roots, size_t n, RefCopy* copy)
+{
+    size_t numNodes = graph->nodes.limit;
+    uint8_t* reached = calloc(numNodes, 1);
+    uint32_t* stack = malloc((numNodes + 1) * sizeof(uint32_t));
+    RefVtxRange* ranges = malloc((numNodes + 1) * sizeof(RefVtxRange));
+    size_t numRanges = 0;
+    size_t numGroups = 0;
+    size_t top = 0;
+
+    copy->vtxGroups = malloc((numNodes + 1) * sizeof(uint32_t));
+    copy->groups = malloc((numNodes + 1) * sizeof(RefVtxGroup));
+    if (reached == NULL || stack == NULL || ranges == NULL || copy->vtxGroups == NULL || copy->groups == NULL)
+    {
+        free(reached);
+        free(stack);
+        free(ranges);
+        return DisplayList_ErrMsgSet("Could not allocate memory for planning vertices of %lu graph nodes\n", numNodes);
+    }
+    memset(copy->vtxGroups, 0xFF, numNodes * sizeof(uint32_t));
+
+    // only vertices the roots use, so no group covers bytes nothing points to
+    for (size_t i = 0; i < n; i++)
+    {
+        if (roots[i] == REFGRAPH_NONE || reached[roots[i]])
+            continue;
+        reached[roots[i]] = true;
+        stack[top++] = roots[i];
+
+        while (top != 0)
+        {
+            const RefNode* node = RefGraph_Node(graph, stack[--top]);
+            const RefEdge* edges = (const RefEdge*)graph->edges.start + node->firstEdge;
+
+            if (node->type == DL_DATA_VTX)
+            {
+                ranges[numRanges].start = node->segAddr;
+                ranges[numRanges].end = node->segAddr + node->size;
+                ranges[numRanges].node = node - (RefNode*)graph->nodes.start;
+                numRanges++;
+            }
+            for (uint32_t j = 0; j < node->numEdges; j++)
+            {
+                if (!reached[edges[j].target])
+                {
+                    reached[edges[j].target] = true;
+                    stack[top++] = edges[j].target;
+                }
+            }
+        }
+    }
+
+    qsort(ranges, numRanges, sizeof(RefVtxRange), RefGraph_CompareVtxRanges);
+
+    for (size_t i = 0; i < numRanges;)
+    {
+        size_t j = i + 1;
+        segaddr_t end = ranges[i].end;
+
+        for (; j < numRanges && ranges[j].start < end; j++)
+        {
+            if (ranges[j].end > end)
+                end = ranges[j].end;
+        }
+        if (j - i > 1)
+        {
+            copy->groups[numGroups].segAddr = ranges[i].start;
+            copy->groups[numGroups].size = end - ranges[i].start;
+            copy->groups[numGroups].newSegAddr = -1;
+            for (size_t k = i; k < j; k++)
+                copy->vtxGroups[ranges[k].node] = numGroups;
+            numGroups++;
+        }
+        i = j;
+    }
+
+    free(reached);
+    free(stack);
+    free(ranges);
+    return 0;
+}
+
+/*
+ * Copies a piece of data, as part of its vertex group if it has one
+ */
+static int
+RefGraph_CopyTarget (RefGraph* graph, RefCopy* copy, uint32_t target)
+{
+    const RefNode* node = RefGraph_Node(graph, target);
+
+    if (copy->vtxGroups == NULL || copy->vtxGroups[target] == REFGRAPH_NONE)
+        return RefGraph_CopyData(graph, node, copy->obj2, &copy->newAddrs[target]);
+
+    RefVtxGroup* group = &copy->groups[copy->vtxGroups[target]];
+    if (group->newSegAddr == (segaddr_t)-1)
+    {
+        RefNode span = { .segAddr = group->segAddr, .size = group->size, .type = DL_DATA_VTX };
+
+        if (RefGraph_CopyData(graph, &span, copy->obj2, &group->newSegAddr) != 0)
+            return -1;
+    }
+    copy->newAddrs[target] = group->newSegAddr + (node->segAddr - group->segAddr);
+    return 0;
+}
+
+/*
+ * Copies the display list at node and everything it points to, depth first in the order the edges were decoded so the
+ * output is laid out as a decoding copy would lay it out. Display lists found in the memo are not copied again, and
+ * every display list copied is added to it.
+ */
+static int
+RefGraph_CopyRoot (RefGraph* graph, RefCopy* copy, uint32_t root)
+{
+    Vector* frames = &graph->frames;
+    RefMemo* memo = copy->memo;
+    segaddr_t* newAddrs = copy->newAddrs;
+    RefCopyFrame* frame;
+
+    if (newAddrs[root] != (segaddr_t)-1 ||
+        RefMemo_Reuse(memo, RefGraph_Node(graph, root), (memo != NULL) ? copy->hashes[root] : 0, &newAddrs[root]))
+        return 0;
+
+    Vector_Clear(frames);
+    frame = Vector_PushBack(frames, 1, NULL);
+    if (frame == NULL)
+        return DisplayList_ErrMsgSet("Could not allocate memory for display list copied from %08X\n", RefGraph_Node(graph, root)->segAddr);
+    frame->node = root;
+    frame->edge = 0;
+
+    while (frames->limit != 0)
+    {
+        frame = Vector_At(frames, frames->limit - 1);
+
+        const RefNode* node = RefGraph_Node(graph, frame->node);
+
+        if (frame->edge == node->numEdges)
+        {
+            if (RefGraph_CopyDisplayList(graph, copy, node) != 0)
+                return -1;
+            if (memo != NULL && copy->hashes[frame->node] != 0)
+            {
+                if (RefMemo_Set(memo, node->segAddr, newAddrs[frame->node], copy->hashes[frame->node]) != 0)
+                    return -1;
+                memo->numCopied++;
+            }
+            Vector_Erase(frames, frames->limit - 1, 1);
+            continue;
+        }
+
+        uint32_t target = ((RefEdge*)graph->edges.start)[node->firstEdge + frame->edge].target;
+        const RefNode* targetNode = RefGraph_Node(graph, target);
+
+        if (newAddrs[target] == (segaddr_t)-1)
+        {
+            if (targetNode->type == DL_REF_DL)
+            {
+                if (RefMemo_Reuse(memo, targetNode, (memo != NULL) ? copy->hashes[target] : 0, &newAddrs[target]))
+                    continue;
+
+                // called display lists are copied first, the edge is looked at again once they are
+                if (graph->maxDepth > 0 && frames->limit >= (size_t)graph->maxDepth)
+                    return DisplayList_ErrMsgSet("Display lists nested more than %d deep at %08X\n", graph->maxDepth, targetNode->segAddr);
+
+                frame = Vector_PushBack(frames, 1, NULL);
+                if (frame == NULL)
+                    return DisplayList_ErrMsgSet("Could not allocate memory for display list copied from %08X\n", targetNode->segAddr);
+                frame->node = target;
+                frame->edge = 0;
+                continue;
+            }
+            if (RefGraph_CopyTarget(graph, copy, target) != 0)
+                return -1;
+        }
+        frame->edge++;
+    }
+    return 0;
+}
+
+/*
+ * Copies n root display lists and everything they point to into obj2, adding any that are not in the graph yet. Like
+ * DisplayList_CopyBatch, a root that fails does not stop the others, its entry in newSegAddrs is set to -1 and its
+ * error is collected into the error message. Returns the number of roots that failed.
+ */
+int
+RefGraph_Copy (RefGraph* graph, const segaddr_t* segAddrs, size_t n, ZObj* obj2, segaddr_t* newSegAddrs)
+{
+    return RefGraph_CopyIncremental(graph, segAddrs, n, obj2, newSegAddrs, NULL);
+}
+
+/*
+ * RefGraph_Copy into an output that earlier runs copied into, reusing the display lists in memo that are unchanged in
+ * the source and adding everything copied to it. Data is appended only if the output does not hold it already. memo
+ * may be NULL.
+ */
+int
+RefGraph_CopyIncremental (RefGraph* graph, const segaddr_t* segAddrs, size_t n, ZObj* obj2, segaddr_t* newSegAddrs,
+                          RefMemo* memo)
+{
+    char errors[1024] = { 0 };
+    int numFailed = 0;
+    uint32_t* roots = malloc(n * sizeof(uint32_t));
+    RefCopy copy = { .obj2 = obj2, .memo = memo };
+    bool planned = true;
+
+    DisplayList_DedupNew(&copy.dedup, graph->dedupMode);
+    Vector_New(&copy.dl, SIZEOF_GFX);
+
+    // add every root first so the copies of all nodes fit in one array
+    if (roots != NULL)
+    {
+        numFailed = RefGraph_Build(graph, segAddrs, n, roots);
+        strncat(errors, DisplayList_ErrMsg(), sizeof(errors) - 1);
+        copy.newAddrs = malloc((graph->nodes.limit + 1) * sizeof(segaddr_t));
+        if (memo != NULL)
+        {
+            copy.hashes = malloc((graph->nodes.limit + 1) * sizeof(uint64_t));
+            planned = (copy.hashes != NULL && RefGraph_Hash(graph, copy.hashes) == 0);
+        }
+        if (graph->coalesceVtx && planned)
+            planned = (RefGraph_PlanVertices(graph, roots, n, &copy) == 0);
+    }
+    if (copy.newAddrs == NULL || !planned)
+    {
+        for (size_t i = 0; i < n; i++)
+            newSegAddrs[i] = -1;
+        numFailed = n;
+        DisplayList_ErrMsgSet("Could not allocate memory for copying %lu roots\n", n);
+        goto end;
+    }
+    memset(copy.newAddrs, 0xFF, graph->nodes.limit * sizeof(segaddr_t));
+    if (memo != NULL)
+        memo->numReused = memo->numCopied = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        newSegAddrs[i] = -1;
+        if (roots[i] == REFGRAPH_NONE)
+            continue;
+
+        if (RefGraph_CopyRoot(graph, &copy, roots[i]) != 0)
+        {
+            RefGraph_RootError(errors, sizeof(errors), i, segAddrs[i]);
+            numFailed++;
+            continue;
+        }
+        newSegAddrs[i] = copy.newAddrs[roots[i]];
+    }
+    DisplayList_ErrMsgSet("%s", errors);
+end:
+    Vector_Destroy(&copy.dl);
+    DisplayList_DedupFree(&copy.dedup);
+    free(copy.groups);
+    free(copy.vtxGroups);
+    free(copy.hashes);
+    free(copy.newAddrs);
+    free(roots);
+    return numFailed;
+}
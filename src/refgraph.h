@@ -0,0 +1,109 @@
+#ifndef REFGRAPH_H_
+#define REFGRAPH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "addrmap.h"
+#include "displaylist.h"
+#include "vector.h"
+#include "zobj.h"
+
+#define REFGRAPH_NONE ((uint32_t)-1)
+
+/*
+ * A display list or a piece of data it points to. Data is identified by address and size, so the same address loaded
+ * with two different sizes is two nodes.
+ */
+typedef struct RefNode {
+    segaddr_t segAddr;
+    uint32_t size;          // bytes, for display lists up to and including the command that ends them
+    uint32_t firstEdge;     // edges of display lists, data has none
+    uint32_t numEdges;
+    uint32_t next;          // next data node at the same address, REFGRAPH_NONE if none
+    int type;               // DLDataType, or DL_REF_DL
+} RefNode;
+
+/*
+ * A pointer from a display list, the edges of a display list are in the order a copy meets them
+ */
+typedef struct RefEdge {
+    uint32_t patchPos;      // offset in the display list of the command holding the pointer
+    uint32_t target;        // node pointed to
+} RefEdge;
+
+/*
+ * Everything reachable from a set of root display lists in an object, decoded once. Copying from the graph gives the
+ * same result as copying with DisplayList_CopyBatch, without decoding the display lists again.
+ */
+typedef struct RefGraph {
+    ZObj* obj;
+    Vector nodes;
+    Vector edges;
+    // segmented address -> display list node
+    AddrMap dlNodes;
+    // segmented address -> newest data node at that address, older ones are chained through next
+    AddrMap dataNodes;
+    // display list nodes waiting to be decoded
+    Vector pending;
+    // nodes in the copy currently being made, innermost last
+    Vector frames;
+    // maximum number of nested display lists to follow when copying, 0 for no limit
+    int maxDepth;
+    // copy vertices from overlapping source ranges as one run instead of one copy per G_VTX
+    bool coalesceVtx;
+    // how copied display lists are deduplicated against the others copied into the same output
+    DLDedupMode dedupMode;
+} RefGraph;
+
+/*
+ * Display lists copied into an output by earlier runs. Each is keyed by its source address and a hash of everything it
+ * reaches in the source, so a display list is only reused while neither it nor anything it uses has changed.
+ */
+typedef struct RefMemoEntry {
+    segaddr_t segAddr;
+    segaddr_t newSegAddr;
+    uint64_t hash;
+} RefMemoEntry;
+
+typedef struct RefMemo {
+    // source address -> entry
+    AddrMap index;
+    Vector entries;
+    // display lists reused and copied by the last RefGraph_CopyIncremental
+    size_t numReused;
+    size_t numCopied;
+} RefMemo;
+
+int
+RefGraph_New (RefGraph* graph, ZObj* obj);
+
+int
+RefGraph_Free (RefGraph* graph);
+
+int
+RefGraph_Add (RefGraph* graph, segaddr_t segAddr, uint32_t* node);
+
+int
+RefGraph_Build (RefGraph* graph, const segaddr_t* segAddrs, size_t n, uint32_t* nodes);
+
+int
+RefGraph_Copy (RefGraph* graph, const segaddr_t* segAddrs, size_t n, ZObj* obj2, segaddr_t* newSegAddrs);
+
+int
+RefGraph_CopyIncremental (RefGraph* graph, const segaddr_t* segAddrs, size_t n, ZObj* obj2, segaddr_t* newSegAddrs,
+                          RefMemo* memo);
+
+int
+RefMemo_New (RefMemo* memo);
+
+int
+RefMemo_Free (RefMemo* memo);
+
+int
+RefMemo_Read (RefMemo* memo, ZObj* obj2, const char* path);
+
+int
+RefMemo_Write (const RefMemo* memo, ZObj* obj2, const char* path);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ *  Tables of the pointers patched in a copy, for moving the copy elsewhere later
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dldata.h"
+#include "errmsg.h"
+#include "macros.h"
+#include "reloc.h"
+
+#define RELOC_FILE_MAGIC    0x5A52454C  // "ZREL"
+#define RELOC_HEADER_SIZE   12
+#define RELOC_ENTRY_SIZE    12
+
+// DisplayListRef type -> RelocKind saved for it
+static const uint8_t reloc_kinds[] = {
+    [DL_DATA_VTX]           = RELOC_KIND_VTX,
+    [DL_DATA_MTX]           = RELOC_KIND_MTX,
+    [DL_DATA_LIGHT]         = RELOC_KIND_LIGHT,
+    [DL_DATA_VIEWPORT]      = RELOC_KIND_VIEWPORT,
+    [DL_DATA_FORCED_MTX]    = RELOC_KIND_FORCED_MTX,
+    [DL_DATA_TEXTURE]       = RELOC_KIND_TEXTURE,
+    [DL_DATA_TLUT]          = RELOC_KIND_TLUT,
+    [DL_DATA_ANIM_FRAMES]   = RELOC_KIND_ANIM_FRAMES,
+    [DL_DATA_ANIM_JOINTS]   = RELOC_KIND_ANIM_JOINTS,
+    [DL_REF_DL]             = RELOC_KIND_DL,
+    [DL_REF_STRUCT]         = RELOC_KIND_STRUCT,
+};
+
+/*
+ * Returns the DisplayListRef type saved as a RelocKind, or -1 if it is not one
+ */
+static int
+Reloc_KindFromFile (uint8_t relocKind)
+{
+    for (size_t i = 0; i < ARRLEN(reloc_kinds); i++)
+    {
+        if (reloc_kinds[i] == relocKind)
+            return i;
+    }
+    return -1;
+}
+
+int
+Reloc_New (RelocTable* table, segaddr_t base)
+{
+    table->base = base;
+    Vector_New(&table->relocs, sizeof(Reloc));
+    AddrMap_New(&table->index);
+    return 0;
+}
+
+int
+Reloc_Free (RelocTable* table)
+{
+    Vector_Destroy(&table->relocs);
+    AddrMap_Destroy(&table->index);
+    return 0;
+}
+
+/*
+ * Records that the word at offset in the output was patched from oldAddr to newAddr, replacing what was recorded for
+ * that word before
+ */
+int
+Reloc_Add (RelocTable* table, uint32_t offset, segaddr_t oldAddr, segaddr_t newAddr, int kind)
+{
+    Reloc reloc = { offset, oldAddr, newAddr, kind };
+    uint32_t i;
+
+    if (SEGMENT_OFFSET(offset) != offset)
+        return DisplayList_ErrMsgSet("Relocation at %08X is outside of any segment\n", offset);
+
+    if (AddrMap_Get(&table->index, offset, &i))
+    {
+        *(Reloc*)Vector_At(&table->relocs, i) = reloc;
+        return 0;
+    }
+    if (Vector_PushBack(&table->relocs, 1, &reloc) == NULL ||
+        AddrMap_Set(&table->index, offset, table->relocs.limit - 1) != 0)
+        return DisplayList_ErrMsgSet("Could not record relocation at %08X\n", offset);
+    return 0;
+}
+
+/*
+ * Moves every pointer recorded in the table from the table's base to base, in obj and in the table. obj is the
+ * output the table was recorded for, it must be writable and is not indexed for duplicates again.
+ */
+int
+Reloc_Rebase (RelocTable* table, ZObj* obj, segaddr_t base)
+{
+    segaddr_t delta = base - table->base;
+    Reloc* reloc;
+
+    if (obj->readOnly)
+        return DisplayList_ErrMsgSet("Cannot rebase an object that is read-only\n");
+
+    VECTOR_FOR_EACH_ELEMENT(&table->relocs, reloc)
+    {
+        uint8_t* word = ZObj_FromSegment(obj, SEGMENT_ADDR(obj->segmentNumber, reloc->offset));
+
+        if (word == NULL || reloc->offset + sizeof(segaddr_t) > obj->limit)
+            return DisplayList_ErrMsgSet("Relocation at %08X is outside of the object\n", reloc->offset);
+        reloc->newAddr += delta;
+        WRITE_32_BE(word, 0, reloc->newAddr);
+    }
+    table->base = base;
+    return 0;
+}
+
+/*
+ * Loads a table saved by Reloc_Write into an empty table
+ */
+int
+Reloc_Read (RelocTable* table, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    uint8_t header[RELOC_HEADER_SIZE];
+    uint32_t count;
+
+    if (file == NULL)
+        return DisplayList_ErrMsgSet("Could not open %s\n", path);
+
+    if (fread(header, sizeof(header), 1, file) != 1 || READ_32_BE(header, 0) != RELOC_FILE_MAGIC)
+        goto bad;
+
+    count = READ_32_BE(header, 4);
+    table->base = READ_32_BE(header, 8);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint8_t entry[RELOC_ENTRY_SIZE];
+        int kind;
+
+        if (fread(entry, sizeof(entry), 1, file) != 1)
+            goto bad;
+        kind = Reloc_KindFromFile(entry[0]);
+        if (kind < 0 ||
+            Reloc_Add(table, SEGMENT_OFFSET(READ_32_BE(entry, 0)), READ_32_BE(entry, 4), READ_32_BE(entry, 8),
+                      kind) != 0)
+            goto bad;
+    }
+    fclose(file);
+    return 0;
+bad:
+    fclose(file);
+    Vector_Clear(&table->relocs);
+    AddrMap_Clear(&table->index);
+    return DisplayList_ErrMsgSet("%s is not a relocation table\n", path);
+}
+
+static int
+Reloc_Compare (const void* a, const void* b)
+{
+    const Reloc* relocA = a;
+    const Reloc* relocB = b;
+
+    return (relocA->offset > relocB->offset) - (relocA->offset < relocB->offset);
+}
+
+/*
+ * Saves the table in ascending offset order, big-endian so that it can be loaded as it is along with the output: a
+ * header of the magic "ZREL", the number of entries and the base, then per entry the patched word's offset with its
+ * RelocKind in the top byte, the old address and the new address
+ */
+int
+Reloc_Write (RelocTable* table, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    uint8_t header[RELOC_HEADER_SIZE];
+    Reloc* reloc;
+    int ret = 0;
+
+    if (file == NULL)
+        return DisplayList_ErrMsgSet("Could not open %s for writing\n", path);
+
+    // sorting moves the entries, so their index is built again
+    qsort(table->relocs.start, table->relocs.limit, sizeof(Reloc), Reloc_Compare);
+    AddrMap_Clear(&table->index);
+    for (size_t i = 0; i < table->relocs.limit; i++)
+    {
+        if (AddrMap_Set(&table->index, ((Reloc*)table->relocs.start)[i].offset, i) != 0)
+            ret = DisplayList_ErrMsgSet("Could not index relocations\n");
+    }
+
+    WRITE_32_BE(header, 0, RELOC_FILE_MAGIC);
+    WRITE_32_BE(header, 4, table->relocs.limit);
+    WRITE_32_BE(header, 8, table->base);
+    if (fwrite(header, sizeof(header), 1, file) != 1)
+        ret = -1;
+    VECTOR_FOR_EACH_ELEMENT(&table->relocs, reloc)
+    {
+        uint8_t entry[RELOC_ENTRY_SIZE];
+
+        if (ret != 0)
+            break;
+        if (reloc->kind >= ARRLEN(reloc_kinds))
+        {
+            fclose(file);
+            return DisplayList_ErrMsgSet("Relocation at %08X has no kind to save\n", reloc->offset);
+        }
+        WRITE_32_BE(entry, 0, (uint32_t)reloc_kinds[reloc->kind] << 24 | reloc->offset);
+        WRITE_32_BE(entry, 4, reloc->oldAddr);
+        WRITE_32_BE(entry, 8, reloc->newAddr);
+        if (fwrite(entry, sizeof(entry), 1, file) != 1)
+            ret = -1;
+    }
+    if (fclose(file) != 0)
+        ret = -1;
+    if (ret != 0)
+        return DisplayList_ErrMsgSet("Could not write %s\n", path);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef RELOC_H_
+#define RELOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "addrmap.h"
+#include "vector.h"
+#include "zobj.h"
+
+/*
+ * Kinds of what a relocation points to as saved by Reloc_Write. These are part of the file format, so they keep their
+ * values when the kinds used while copying change.
+ */
+typedef enum RelocKind {
+    RELOC_KIND_VTX          = 0,
+    RELOC_KIND_MTX          = 1,
+    RELOC_KIND_LIGHT        = 2,
+    RELOC_KIND_VIEWPORT     = 3,
+    RELOC_KIND_FORCED_MTX   = 4,
+    RELOC_KIND_TEXTURE      = 5,
+    RELOC_KIND_TLUT         = 6,
+    RELOC_KIND_ANIM_FRAMES  = 7,
+    RELOC_KIND_ANIM_JOINTS  = 8,
+    RELOC_KIND_DL           = 9,
+    RELOC_KIND_STRUCT       = 10,
+} RelocKind;
+
+/*
+ * Pointer word that a copy patched in its output
+ */
+typedef struct Reloc {
+    uint32_t offset;        // offset in the output of the patched word
+    segaddr_t oldAddr;      // what the word pointed to in its source
+    segaddr_t newAddr;      // what the word points to in the output now
+    uint8_t kind;           // DisplayListRef type of what is pointed to, or DL_REF_STRUCT
+} Reloc;
+
+/*
+ * Every pointer word patched in one output, each pointing into the output itself. Pointers in the output are relative
+ * to base, the address the output is loaded at, so the output can be moved to another segment or load address by
+ * Reloc_Rebase without decoding anything in it. A word patched twice is recorded once, with what it was patched to
+ * last.
+ */
+typedef struct RelocTable {
+    segaddr_t base;
+    Vector relocs;
+    // offset -> element of relocs
+    AddrMap index;
+} RelocTable;
+
+int
+Reloc_New (RelocTable* table, segaddr_t base);
+
+int
+Reloc_Free (RelocTable* table);
+
+int
+Reloc_Add (RelocTable* table, uint32_t offset, segaddr_t oldAddr, segaddr_t newAddr, int kind);
+
+int
+Reloc_Rebase (RelocTable* table, ZObj* obj, segaddr_t base);
+
+int
+Reloc_Read (RelocTable* table, const char* path);
+
+int
+Reloc_Write (RelocTable* table, const char* path);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ *  Opening objects straight out of a ROM image
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "errmsg.h"
+#include "macros.h"
+#include "rom.h"
+#include "yaz0.h"
+
+#define ROM_HEADER_SIZE     0x40
+#define ROM_MAGIC           0x80371240
+#define DMA_ENTRY_SIZE      16
+
+static void
+Rom_ReadEntry (const ZObj* image, size_t offset, RomFile* file)
+{
+    const uint8_t* entry = (const uint8_t*)image->buffer + offset;
+
+    file->vromStart = READ_32_BE(entry, 0);
+    file->vromEnd = READ_32_BE(entry, 4);
+    file->romStart = READ_32_BE(entry, 8);
+    file->romEnd = READ_32_BE(entry, 12);
+}
+
+/*
+ * Counts the entries of a file table candidate at offset, 0 if it is not the file table. The table starts with the
+ * ROM header file at 0, is ended by an entry of zeros and lists itself as one of its files.
+ */
+static size_t
+Rom_CheckDmaData (const ZObj* image, size_t offset)
+{
+    bool listsItself = false;
+    size_t n;
+    RomFile file;
+
+    Rom_ReadEntry(image, offset, &file);
+    if (file.vromStart != 0 || file.vromEnd == 0 || file.romStart != 0 || file.romEnd != 0)
+        return 0;
+
+    for (n = 0; offset + (n + 1) * DMA_ENTRY_SIZE <= image->limit; n++)
+    {
+        uint32_t prevEnd = file.vromEnd;
+
+        Rom_ReadEntry(image, offset + n * DMA_ENTRY_SIZE, &file);
+        if (file.vromStart == 0 && file.vromEnd == 0 && file.romStart == 0 && file.romEnd == 0)
+            return listsItself ? n : 0;
+
+        // files follow each other in the virtual address space
+        if (file.vromEnd < file.vromStart || (n != 0 && file.vromStart != prevEnd))
+            return 0;
+        if (file.romStart == offset && file.romEnd == 0)
+            listsItself = true;
+    }
+    return 0;
+}
+
+/*
+ * Maps a ROM image and finds its file table
+ */
+int
+Rom_Open (Rom* rom, const char* path)
+{
+    rom->dmaOffset = rom->numFiles = 0;
+
+    // an empty file is left to fail the header check
+    if (ZObj_Map(&rom->image, path, 0) < 0)
+        return -1;
+    if (rom->image.limit < ROM_HEADER_SIZE || READ_32_BE(rom->image.buffer, 0) != ROM_MAGIC)
+    {
+        ZObj_Free(&rom->image);
+        return DisplayList_ErrMsgSet("%s is not a big-endian N64 ROM image\n", path);
+    }
+
+    for (size_t offset = ROM_HEADER_SIZE; offset + DMA_ENTRY_SIZE <= rom->image.limit; offset += DMA_ENTRY_SIZE)
+    {
+        rom->numFiles = Rom_CheckDmaData(&rom->image, offset);
+        if (rom->numFiles != 0)
+        {
+            rom->dmaOffset = offset;
+            return 0;
+        }
+    }
+
+    ZObj_Free(&rom->image);
+    return DisplayList_ErrMsgSet("Could not find the file table of ROM %s\n", path);
+}
+
+int
+Rom_Close (Rom* rom)
+{
+    ZObj_Free(&rom->image);
+    rom->dmaOffset = rom->numFiles = 0;
+    return 0;
+}
+
+int
+Rom_GetFile (const Rom* rom, size_t index, RomFile* file)
+{
+    if (index >= rom->numFiles)
+        return DisplayList_ErrMsgSet("ROM file %lu is out of range, the ROM has %lu files\n", index, rom->numFiles);
+
+    Rom_ReadEntry(&rom->image, rom->dmaOffset + index * DMA_ENTRY_SIZE, file);
+    return 0;
+}
+
+/*
+ * Decompresses the Yaz0 data of size bytes at offset in the ROM into a buffer the object owns, the data must decode to
+ * exactly decodedSize bytes
+ */
+static int
+Rom_Decompress (const Rom* rom, ZObj* view, size_t offset, size_t size, size_t decodedSize, int segNum)
+{
+    const uint8_t* data = (const uint8_t*)rom->image.buffer + offset;
+    uint8_t* buffer;
+
+    if (!Yaz0_IsCompressed(data, size) || Yaz0_DecodedSize(data) != decodedSize)
+        return DisplayList_ErrMsgSet("0x%lX bytes at 0x%lX in the ROM are not valid Yaz0 data\n", size, offset);
+
+    buffer = malloc((decodedSize == 0) ? 1 : decodedSize);
+    if (buffer == NULL)
+        return DisplayList_ErrMsgSet("Could not allocate memory to decompress 0x%lX bytes at 0x%lX in the ROM\n", size,
+                                     offset);
+
+    if (Yaz0_Decode(data, size, buffer, decodedSize) != 0)
+    {
+        free(buffer);
+        return DisplayList_ErrMsgSet("0x%lX bytes at 0x%lX in the ROM are not valid Yaz0 data\n", size, offset);
+    }
+
+    // the object owns the buffer and frees it with ZObj_Free
+    ZObj_New(view, segNum);
+    view->buffer = buffer;
+    view->limit = view->capacity = decodedSize;
+    return 0;
+}
+
+/*
+ * Opens size bytes of the ROM at offset as an object. Uncompressed data is viewed in the mapping without copying, Yaz0
+ * data is recognized by its header and decompressed into a buffer the object owns.
+ */
+int
+Rom_View (const Rom* rom, ZObj* view, size_t offset, size_t size, int segNum)
+{
+    if (offset > rom->image.limit || size > rom->image.limit - offset)
+        return DisplayList_ErrMsgSet("0x%lX bytes at 0x%lX are outside of the ROM\n", size, offset);
+
+    if (Yaz0_IsCompressed((const uint8_t*)rom->image.buffer + offset, size))
+        return Rom_Decompress(rom, view, offset, size, Yaz0_DecodedSize((const uint8_t*)rom->image.buffer + offset),
+                              segNum);
+
+    ZObj_View(view, &rom->image, offset, size, segNum);
+    return 0;
+}
+
+/*
+ * Opens a file listed in the file table as an object. Uncompressed files are viewed in the mapping, compressed files
+ * are decompressed into a buffer the object owns.
+ */
+int
+Rom_ViewFile (const Rom* rom, ZObj* view, size_t index, int segNum)
+{
+    RomFile file;
+    size_t size;
+
+    if (index >= rom->numFiles)
+        return DisplayList_ErrMsgSet("ROM file %lu is out of range, the ROM has %lu files\n", index, rom->numFiles);
+
+    Rom_ReadEntry(&rom->image, rom->dmaOffset + index * DMA_ENTRY_SIZE, &file);
+    if (file.romStart == 0xFFFFFFFF)
+        return DisplayList_ErrMsgSet("ROM file %lu is not present in the ROM\n", index);
+
+    size = file.vromEnd - file.vromStart;
+    if (file.romEnd == 0)
+    {
+        // the file table says it is not compressed, even if it happens to start like Yaz0
+        if (ZObj_View(view, &rom->image, file.romStart, size, segNum) != 0)
+            return DisplayList_ErrMsgSet("ROM file %lu is outside of the ROM\n", index);
+        return 0;
+    }
+
+    if (file.romEnd < file.romStart || file.romEnd > rom->image.limit)
+        return DisplayList_ErrMsgSet("ROM file %lu is not valid Yaz0 data\n", index);
+    return Rom_Decompress(rom, view, file.romStart, file.romEnd - file.romStart, size, segNum);
+}
@@ -0,0 +1,45 @@
+#ifndef ROM_H_
+#define ROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "zobj.h"
+
+/*
+ * Entry of a ROM's file table (dmadata). Files are uncompressed at romStart if romEnd is 0, otherwise they are Yaz0
+ * compressed between romStart and romEnd. Files missing from the ROM have romStart and romEnd set to -1.
+ */
+typedef struct RomFile {
+    uint32_t vromStart;
+    uint32_t vromEnd;
+    uint32_t romStart;
+    uint32_t romEnd;
+} RomFile;
+
+/*
+ * Big-endian ROM image mapped once, that any number of objects can be opened from as views. Views share the mapping
+ * and stay valid after the ROM is closed. A ROM may be read from any number of threads at once.
+ */
+typedef struct Rom {
+    ZObj image;
+    size_t dmaOffset;   // offset of the file table in the image
+    size_t numFiles;
+} Rom;
+
+int
+Rom_Open (Rom* rom, const char* path);
+
+int
+Rom_Close (Rom* rom);
+
+int
+Rom_GetFile (const Rom* rom, size_t index, RomFile* file);
+
+int
+Rom_View (const Rom* rom, ZObj* view, size_t offset, size_t size, int segNum);
+
+int
+Rom_ViewFile (const Rom* rom, ZObj* view, size_t index, int segNum);
+
+#endif
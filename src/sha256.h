@@ -0,0 +1,12 @@
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+
+void
+Sha256 (const void* data, size_t size, uint8_t hash[SHA256_SIZE]);
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ *  Copying skeletons together with their limbs and the display lists the limbs draw
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "skeleton.h"
+
+#define SIZEOF_SKELETON_HEADER      8
+#define SIZEOF_FLEX_SKELETON_HEADER 12
+#define SIZEOF_STANDARD_LIMB        12
+#define SIZEOF_LOD_LIMB             16
+#define LIMB_DL_OFFSET              8   // both limb layouts start with the joint position, child and sibling
+
+/*
+ * Finds size bytes at an address in one of the session's source objects
+ */
+static const uint8_t*
+Skeleton_Source (DisplayListSession* session, segaddr_t segAddr, size_t size, const char* what)
+{
+    ZObj* obj = session->segments[SEGMENT_NUMBER(segAddr)];
+    const uint8_t* data = (obj == NULL) ? NULL : ZObj_FromSegment(obj, segAddr);
+
+    if (data == NULL || size > obj->limit - SEGMENT_OFFSET(segAddr))
+    {
+        DisplayList_ErrMsgSet("Bad segmented address 0x%08X for %s\n", segAddr, what);
+        return NULL;
+    }
+    return data;
+}
+
+/*
+ * Copies the display lists of a limb and then the limb pointing to their copies. Null display lists and display lists
+ * in segments without a source object are left as they are.
+ */
+static int
+Skeleton_CopyLimb (DisplayListSession* session, segaddr_t segAddr, int numDLs, segaddr_t* newSegAddr)
+{
+    size_t size = LIMB_DL_OFFSET + numDLs * sizeof(segaddr_t);
+    const uint8_t* src = Skeleton_Source(session, segAddr, size, "limb");
+    uint8_t limb[SIZEOF_LOD_LIMB];
+    segaddr_t oldDLs[2] = { 0, 0 };
+
+    if (src == NULL)
+        return -1;
+    memcpy(limb, src, size);
+
+    for (int i = 0; i < numDLs; i++)
+    {
+        segaddr_t dl = READ_32_BE(limb, LIMB_DL_OFFSET + i * sizeof(segaddr_t));
+        segaddr_t newDL;
+
+        if (dl == 0 || session->segments[SEGMENT_NUMBER(dl)] == NULL)
+            continue;
+        if (DisplayList_SessionCopy(session, dl, &newDL) != 0)
+            return -1;
+        WRITE_32_BE(limb, LIMB_DL_OFFSET + i * sizeof(segaddr_t), newDL);
+        oldDLs[i] = dl;
+    }
+    if (DisplayList_SessionAddData(session, limb, size, newSegAddr) != 0)
+        return -1;
+
+    for (int i = 0; i < numDLs; i++)
+    {
+        if (oldDLs[i] != 0 &&
+            DisplayList_SessionAddReloc(session, *newSegAddr + LIMB_DL_OFFSET + i * sizeof(segaddr_t), oldDLs[i],
+                                        DL_REF_DL) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Copies a skeleton from the session's source objects into its output in one pass: every limb in the limb table with
+ * the display lists it draws, then the table and the header pointing to the copies. Display lists share the session
+ * with any others copied in it, and limbs, tables and headers are deduplicated against the output like other data.
+ */
+int
+Skeleton_Copy (DisplayListSession* session, segaddr_t segAddr, SkeletonType type, segaddr_t* newSegAddr)
+{
+    size_t headerSize = (type == SKELETON_FLEX || type == SKELETON_FLEX_LOD) ? SIZEOF_FLEX_SKELETON_HEADER
+                                                                             : SIZEOF_SKELETON_HEADER;
+    int numDLs = (type == SKELETON_LOD || type == SKELETON_FLEX_LOD) ? 2 : 1;
+    const uint8_t* src;
+    uint8_t header[SIZEOF_FLEX_SKELETON_HEADER];
+    segaddr_t tableAddr;
+    segaddr_t newTableAddr;
+    uint8_t* table = NULL;
+    int limbCount;
+
+    *newSegAddr = -1;
+
+    src = Skeleton_Source(session, segAddr, headerSize, "skeleton header");
+    if (src == NULL)
+        goto err;
+    memcpy(header, src, headerSize);
+
+    tableAddr = READ_32_BE(header, 0);
+    limbCount = header[4];
+
+    if (limbCount == 0)
+    {
+        DisplayList_ErrMsgSet("Skeleton 0x%08X has no limbs\n", segAddr);
+        goto err;
+    }
+
+    src = Skeleton_Source(session, tableAddr, limbCount * sizeof(segaddr_t), "limb table");
+    if (src == NULL)
+        goto err;
+
+    table = malloc(limbCount * sizeof(segaddr_t));
+    if (table == NULL)
+    {
+        DisplayList_ErrMsgSet("Could not allocate memory for a limb table of %d limbs\n", limbCount);
+        goto err;
+    }
+    memcpy(table, src, limbCount * sizeof(segaddr_t));
+
+    for (int i = 0; i < limbCount; i++)
+    {
+        segaddr_t newLimb;
+
+        if (Skeleton_CopyLimb(session, READ_32_BE(table, i * sizeof(segaddr_t)), numDLs, &newLimb) != 0)
+        {
+            char* msg = strdup(DisplayList_ErrMsg());
+
+            DisplayList_ErrMsgSet("%s  in limb %d of skeleton 0x%08X\n", (msg == NULL) ? "" : msg, i, segAddr);
+            free(msg);
+            goto err;
+        }
+        WRITE_32_BE(table, i * sizeof(segaddr_t), newLimb);
+    }
+
+    if (DisplayList_SessionAddData(session, table, limbCount * sizeof(segaddr_t), &newTableAddr) != 0)
+        goto err;
+    // src still holds the source table, with the limb addresses before they were patched
+    for (int i = 0; i < limbCount; i++)
+    {
+        segaddr_t limbAddr = READ_32_BE(src, i * sizeof(segaddr_t));
+
+        if (DisplayList_SessionAddReloc(session, newTableAddr + i * sizeof(segaddr_t), limbAddr, DL_REF_STRUCT) != 0)
+            goto err;
+    }
+    WRITE_32_BE(header, 0, newTableAddr);
+    if (DisplayList_SessionAddData(session, header, headerSize, newSegAddr) != 0 ||
+        DisplayList_SessionAddReloc(session, *newSegAddr, tableAddr, DL_REF_STRUCT) != 0)
+        goto err;
+
+    free(table);
+    return 0;
+err:
+    free(table);
+    *newSegAddr = -1;
+    return -1;
+}
@@ -0,0 +1,21 @@
+#ifndef SKELETON_H_
+#define SKELETON_H_
+
+#include "displaylist.h"
+
+/*
+ * Layouts of skeletons, by header and by limb. Flex skeleton headers add a display list count to the plain header,
+ * LOD limbs have a near and a far display list where standard limbs have one.
+ */
+typedef enum SkeletonType {
+    SKELETON_STANDARD,      // SkeletonHeader of StandardLimbs
+    SKELETON_LOD,           // SkeletonHeader of LodLimbs
+    SKELETON_FLEX,          // FlexSkeletonHeader of StandardLimbs
+    SKELETON_FLEX_LOD,      // FlexSkeletonHeader of LodLimbs, like the player's
+    SKELETON_MAX,
+} SkeletonType;
+
+int
+Skeleton_Copy (DisplayListSession* session, segaddr_t segAddr, SkeletonType type, segaddr_t* newSegAddr);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ *  Removing everything a set of root display lists does not reach from an object, in place
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "displaylist.h"
+#include "refgraph.h"
+#include "strip.h"
+
+/*
+ * Bytes of the object kept as one piece, from the start of the first node in it to the end of the last, rounded out
+ * to 8 bytes so that everything keeps its alignment
+ */
+typedef struct StripExtent {
+    uint32_t start;
+    uint32_t end;
+    uint32_t newStart;
+} StripExtent;
+
+typedef struct StripItem {
+    uint32_t start;
+    uint32_t end;
+    uint32_t node;
+} StripItem;
+
+static int
+Strip_CompareItems (const void* a, const void* b)
+{
+    const StripItem* itemA = a;
+    const StripItem* itemB = b;
+
+    if (itemA->start != itemB->start)
+        return (itemA->start > itemB->start) ? 1 : -1;
+    return (itemA->end > itemB->end) - (itemA->end < itemB->end);
+}
+
+static segaddr_t
+Strip_NewAddr (const RefGraph* graph, const StripExtent* extents, const uint32_t* extentOf, uint32_t node)
+{
+    const StripExtent* extent = &extents[extentOf[node]];
+    segaddr_t segAddr = ((const RefNode*)graph->nodes.start)[node].segAddr;
+
+    return SEGMENT_ADDR(graph->obj->segmentNumber, extent->newStart + (SEGMENT_OFFSET(segAddr) - extent->start));
+}
+
+/*
+ * Keeps only what the root display lists reach in obj, moving it down over everything else in one sweep in address
+ * order and patching every pointer to what moved. newSegAddrs receives the new addresses of the roots. Unlike copying
+ * or Layout_Optimize no second object is built, so this needs no more memory than the graph of the roots. obj must be
+ * writable, a chunked obj is flattened first. Nothing is changed if this fails.
+ */
+int
+Strip_Compact (ZObj* obj, const segaddr_t* segAddrs, size_t n, segaddr_t* newSegAddrs)
+{
+    RefGraph graph;
+    uint32_t* roots = malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* extentOf = NULL;
+    StripItem* items = NULL;
+    StripExtent* extents = NULL;
+    size_t numExtents = 0;
+    uint32_t newLimit = 0;
+    int ret = -1;
+
+    RefGraph_New(&graph, obj);
+    if (obj->readOnly)
+    {
+        DisplayList_ErrMsgSet("Cannot strip a read-only object\n");
+        goto end;
+    }
+    if (roots == NULL || ZObj_Flatten(obj) != 0)
+    {
+        DisplayList_ErrMsgSet("Could not allocate memory for stripping %lu roots\n", n);
+        goto end;
+    }
+    if (RefGraph_Build(&graph, segAddrs, n, roots) != 0)
+        goto end;
+
+    size_t numNodes = graph.nodes.limit;
+    extentOf = malloc((numNodes + 1) * sizeof(uint32_t));
+    items = malloc((numNodes + 1) * sizeof(StripItem));
+    extents = malloc((numNodes + 1) * sizeof(StripExtent));
+    if (extentOf == NULL || items == NULL || extents == NULL)
+    {
+        DisplayList_ErrMsgSet("Could not allocate memory for stripping %lu graph nodes\n", numNodes);
+        goto end;
+    }
+
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        const RefNode* node = (const RefNode*)graph.nodes.start + i;
+
+        items[i].start = SEGMENT_OFFSET(node->segAddr) & ~7;
+        items[i].end = ALIGN8(SEGMENT_OFFSET(node->segAddr) + node->size);
+        // the object itself may end unaligned
+        if (items[i].end > obj->limit)
+            items[i].end = obj->limit;
+        items[i].node = i;
+    }
+    qsort(items, numNodes, sizeof(StripItem), Strip_CompareItems);
+
+    // merge overlapping nodes into extents and place each right after the one before it
+    for (size_t i = 0; i < numNodes;)
+    {
+        StripExtent* extent = &extents[numExtents];
+        bool hasDL = false;
+        bool hasData = false;
+        size_t j = i;
+
+        extent->start = items[i].start;
+        extent->end = items[i].end;
+        for (; j < numNodes && (j == i || items[j].start < extent->end); j++)
+        {
+            const RefNode* node = (const RefNode*)graph.nodes.start + items[j].node;
+
+            if (items[j].end > extent->end)
+                extent->end = items[j].end;
+            // data of no size, such as a 4-bit texture load, holds no bytes that patching could change
+            hasDL |= (node->type == DL_REF_DL);
+            hasData |= (node->type != DL_REF_DL && node->size != 0);
+            extentOf[items[j].node] = numExtents;
+        }
+
+        // patching the display list would change the data too, which a copy keeps apart but stripping cannot
+        if (hasDL && hasData)
+        {
+            DisplayList_ErrMsgSet("Display list and data overlap at 0x%06X-0x%06X, the object cannot be stripped in place\n",
+                                  extent->start, extent->end);
+            goto end;
+        }
+
+        extent->newStart = newLimit;
+        newLimit += extent->end - extent->start;
+        numExtents++;
+        i = j;
+    }
+
+    // extents are in address order and only ever move down, so moving them in that order overwrites nothing still needed
+    for (size_t i = 0; i < numExtents; i++)
+    {
+        uint8_t* buffer = obj->buffer;
+
+        memmove(buffer + extents[i].newStart, buffer + extents[i].start, extents[i].end - extents[i].start);
+    }
+
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        const RefNode* node = (const RefNode*)graph.nodes.start + i;
+        const RefEdge* edges = (const RefEdge*)graph.edges.start + node->firstEdge;
+        uint8_t* dl = (uint8_t*)obj->buffer + SEGMENT_OFFSET(Strip_NewAddr(&graph, extents, extentOf, i));
+
+        for (uint32_t j = 0; j < node->numEdges; j++)
+            WRITE_32_BE(dl, edges[j].patchPos + 4, Strip_NewAddr(&graph, extents, extentOf, edges[j].target));
+    }
+    for (size_t i = 0; i < n; i++)
+        newSegAddrs[i] = Strip_NewAddr(&graph, extents, extentOf, roots[i]);
+
+    ZObj_Truncate(obj, newLimit);
+    ret = 0;
+end:
+    RefGraph_Free(&graph);
+    free(extents);
+    free(items);
+    free(extentOf);
+    free(roots);
+    return ret;
+}
@@ -0,0 +1,11 @@
+#ifndef STRIP_H_
+#define STRIP_H_
+
+#include <stddef.h>
+
+#include "zobj.h"
+
+int
+Strip_Compact (ZObj* obj, const segaddr_t* segAddrs, size_t n, segaddr_t* newSegAddrs);
+
+#endif
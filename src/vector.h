@@ -36,7 +36,7 @@ void*
 Vector_PushBack (Vector* vector, size_t num, const void* data);
 
 int
-Vector_Delete (Vector* vector, size_t position, size_t num);
+Vector_Erase (Vector* vector, size_t position, size_t num);
 
 int
 Vector_Resize (Vector* vector);
@@ -0,0 +1,181 @@
+/*
+ *  Work-stealing thread pool for running a fixed set of independent jobs
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "workpool.h"
+
+/*
+ * Jobs are dealt out to per-worker queues up front. A worker takes jobs from the bottom of its own queue and, once it
+ * runs dry, steals from the top of the other queues. No jobs are added while running, so a worker that finds every
+ * queue empty is finished.
+ */
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    size_t* jobs;
+    size_t top;     // next job to be stolen
+    size_t bottom;  // one past the next job to be taken by the owner
+} WorkQueue;
+
+typedef struct WorkPool {
+    WorkQueue* queues;
+    int numWorkers;
+    WorkPoolJob func;
+    void* arg;
+} WorkPool;
+
+typedef struct Worker {
+    WorkPool* pool;
+    int id;
+} Worker;
+
+static bool
+WorkQueue_Pop (WorkQueue* queue, size_t* job)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->bottom > queue->top)
+    {
+        *job = queue->jobs[--queue->bottom];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool
+WorkQueue_Steal (WorkQueue* queue, size_t* job)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->bottom > queue->top)
+    {
+        *job = queue->jobs[queue->top++];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void*
+WorkPool_Worker (void* arg)
+{
+    Worker* worker = arg;
+    WorkPool* pool = worker->pool;
+    size_t job;
+
+    while (true)
+    {
+        if (!WorkQueue_Pop(&pool->queues[worker->id], &job))
+        {
+            bool stolen = false;
+
+            // visit the other queues starting from the next worker so thieves spread out
+            for (int i = 1; i < pool->numWorkers && !stolen; i++)
+                stolen = WorkQueue_Steal(&pool->queues[(worker->id + i) % pool->numWorkers], &job);
+
+            if (!stolen)
+                break;
+        }
+        pool->func(job, worker->id, pool->arg);
+    }
+    return NULL;
+}
+
+int
+WorkPool_DefaultWorkers (void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (n < 1) ? 1 : n;
+}
+
+/*
+ * Runs func for every job in [0, numJobs) on numWorkers threads. func is given the job number and the number of the
+ * worker running it, which is in [0, numWorkers).
+ */
+int
+WorkPool_Run (size_t numJobs, int numWorkers, WorkPoolJob func, void* arg)
+{
+    WorkPool pool;
+    Worker* workers;
+    pthread_t* threads;
+    int numStarted = 0;
+    int ret = 0;
+
+    if (numWorkers < 1)
+        numWorkers = 1;
+    if ((size_t)numWorkers > numJobs)
+        numWorkers = (numJobs == 0) ? 1 : numJobs;
+
+    if (numWorkers == 1)
+    {
+        for (size_t job = 0; job < numJobs; job++)
+            func(job, 0, arg);
+        return 0;
+    }
+
+    pool.numWorkers = numWorkers;
+    pool.func = func;
+    pool.arg = arg;
+    pool.queues = calloc(numWorkers, sizeof(WorkQueue));
+    workers = calloc(numWorkers, sizeof(Worker));
+    threads = calloc(numWorkers, sizeof(pthread_t));
+    if (pool.queues == NULL || workers == NULL || threads == NULL)
+    {
+        ret = -1;
+        goto end;
+    }
+
+    // deal jobs out round-robin, each queue is popped from the end so lay them out in reverse
+    for (int i = 0; i < numWorkers; i++)
+    {
+        WorkQueue* queue = &pool.queues[i];
+        size_t count = (numJobs - i + numWorkers - 1) / numWorkers;
+
+        queue->jobs = malloc(count * sizeof(size_t));
+        if (queue->jobs == NULL)
+        {
+            ret = -1;
+            goto end;
+        }
+        for (size_t j = 0; j < count; j++)
+            queue->jobs[count - 1 - j] = i + j * numWorkers;
+        queue->top = 0;
+        queue->bottom = count;
+        pthread_mutex_init(&queue->lock, NULL);
+    }
+
+    for (; numStarted < numWorkers; numStarted++)
+    {
+        workers[numStarted].pool = &pool;
+        workers[numStarted].id = numStarted;
+        if (pthread_create(&threads[numStarted], NULL, WorkPool_Worker, &workers[numStarted]) != 0)
+            break;
+    }
+
+    // if not every thread could be started, the ones that were will steal the remaining jobs
+    if (numStarted == 0)
+        ret = -1;
+
+    for (int i = 0; i < numStarted; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < numWorkers; i++)
+        pthread_mutex_destroy(&pool.queues[i].lock);
+end:
+    if (pool.queues != NULL)
+    {
+        for (int i = 0; i < numWorkers; i++)
+            free(pool.queues[i].jobs);
+    }
+    free(pool.queues);
+    free(workers);
+    free(threads);
+    return ret;
+}
@@ -0,0 +1,14 @@
+#ifndef WORKPOOL_H_
+#define WORKPOOL_H_
+
+#include <stddef.h>
+
+typedef void (*WorkPoolJob)(size_t job, int worker, void* arg);
+
+int
+WorkPool_Run (size_t numJobs, int numWorkers, WorkPoolJob func, void* arg);
+
+int
+WorkPool_DefaultWorkers (void);
+
+#endif
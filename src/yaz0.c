@@ -0,0 +1,316 @@
+/*
+ *  Yaz0 compression, as used for files in Zelda 64 ROMs
+ *
+ *  A 16 byte header ("Yaz0", the decompressed size and 8 reserved bytes) is followed by groups of up to 8 items, each
+ *  group preceded by a byte with one bit per item starting from the top: 1 for a literal byte, 0 for a copy of 3 to
+ *  0x111 bytes from up to 0x1000 bytes back.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "workpool.h"
+#include "yaz0.h"
+
+#define YAZ0_WINDOW     0x1000
+#define YAZ0_MIN_MATCH  3
+#define YAZ0_MAX_MATCH  (0xFF + 0x12)
+
+// the input is matched in blocks of this size independently, so the output does not depend on the number of threads
+#define YAZ0_BLOCK_SIZE 0x40000
+
+#define YAZ0_HASH_BITS  14
+#define YAZ0_MAX_CHAIN  32
+
+bool
+Yaz0_IsCompressed (const void* data, size_t size)
+{
+    return size >= YAZ0_HEADER_SIZE && memcmp(data, "Yaz0", 4) == 0;
+}
+
+size_t
+Yaz0_DecodedSize (const void* data)
+{
+    return READ_32_BE(data, 4);
+}
+
+/*
+ * Decodes a whole Yaz0 file into dst, which must hold exactly the decompressed size given in the header. Returns -1 if
+ * the data is truncated or refers to bytes before the start of the output.
+ */
+int
+Yaz0_Decode (const void* src, size_t srcSize, void* dst, size_t dstSize)
+{
+    const uint8_t* in = src;
+    uint8_t* out = dst;
+    size_t s = YAZ0_HEADER_SIZE;
+    size_t d = 0;
+
+    while (d < dstSize)
+    {
+        if (s >= srcSize)
+            return -1;
+
+        uint8_t code = in[s++];
+
+        for (int bit = 0; bit < 8 && d < dstSize; bit++, code <<= 1)
+        {
+            if (code & 0x80)
+            {
+                if (s >= srcSize)
+                    return -1;
+                out[d++] = in[s++];
+                continue;
+            }
+
+            if (srcSize - s < 2)
+                return -1;
+
+            size_t dist = ((in[s] & 0xF) << 8 | in[s + 1]) + 1;
+            size_t len = in[s] >> 4;
+            s += 2;
+
+            if (len != 0)
+            {
+                len += 2;
+            }
+            else
+            {
+                if (s >= srcSize)
+                    return -1;
+                len = in[s++] + 0x12;
+            }
+
+            if (dist > d || len > dstSize - d)
+                return -1;
+
+            if (dist >= len)
+            {
+                memcpy(&out[d], &out[d - dist], len);
+                d += len;
+                continue;
+            }
+            // the copy overlaps the bytes it produces, so byte by byte
+            for (size_t i = 0; i < len; i++, d++)
+                out[d] = out[d - dist];
+        }
+    }
+    return 0;
+}
+
+/*
+ * Items found in one block of the input: a kind per item, 1 for a literal, and the bytes encoding the items
+ */
+typedef struct Yaz0Block {
+    uint8_t* kinds;
+    uint8_t* items;
+    size_t numItems;
+    size_t itemsSize;
+    // set by the thread encoding the block if it ran out of memory, each block has its own so threads share nothing
+    bool failed;
+} Yaz0Block;
+
+typedef struct Yaz0Encoder {
+    const uint8_t* data;
+    size_t size;
+    Yaz0Block* blocks;
+    size_t numBlocks;
+} Yaz0Encoder;
+
+static inline uint32_t
+Yaz0_Hash (const uint8_t* p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 0x9E3779B1U) >> (32 - YAZ0_HASH_BITS);
+}
+
+/*
+ * Greedy hash chain matching of one block. The window reaches back into the previous block, but matches stop at the
+ * end of the block.
+ */
+static void
+Yaz0_EncodeBlock (size_t job, int worker, void* arg)
+{
+    Yaz0Encoder* enc = arg;
+    Yaz0Block* block = &enc->blocks[job];
+    const uint8_t* data = enc->data;
+    size_t start = job * YAZ0_BLOCK_SIZE;
+    size_t end = (enc->size - start < YAZ0_BLOCK_SIZE) ? enc->size : start + YAZ0_BLOCK_SIZE;
+    // positions are stored + 1 so that 0 means none
+    uint32_t* head = calloc(1 << YAZ0_HASH_BITS, sizeof(uint32_t));
+    uint32_t* prev = malloc(YAZ0_WINDOW * sizeof(uint32_t));
+
+    block->kinds = malloc(end - start);
+    block->items = malloc(end - start);
+    block->numItems = block->itemsSize = 0;
+    block->failed = (head == NULL || prev == NULL || block->kinds == NULL || block->items == NULL);
+    if (block->failed)
+        goto end;
+
+#define INSERT(pos) \
+    do { \
+        uint32_t h_ = Yaz0_Hash(&data[pos]); \
+        prev[(pos) % YAZ0_WINDOW] = head[h_]; \
+        head[h_] = (pos) + 1; \
+    } while (0)
+
+    for (size_t pos = (start > YAZ0_WINDOW) ? start - YAZ0_WINDOW : 0; pos < start; pos++)
+        INSERT(pos);
+
+    for (size_t pos = start; pos < end;)
+    {
+        size_t bestLen = 0;
+        size_t bestDist = 0;
+
+        if (end - pos >= YAZ0_MIN_MATCH)
+        {
+            size_t maxLen = (end - pos < YAZ0_MAX_MATCH) ? end - pos : YAZ0_MAX_MATCH;
+            uint32_t cand = head[Yaz0_Hash(&data[pos])];
+
+            for (int chain = 0; cand != 0 && chain < YAZ0_MAX_CHAIN; chain++)
+            {
+                size_t c = cand - 1;
+                size_t len = 0;
+
+                if (pos - c > YAZ0_WINDOW)
+                    break;
+                // a candidate can only be better if it also matches the byte that ends the best match so far
+                if (bestLen != 0 && data[c + bestLen] != data[pos + bestLen])
+                    goto next;
+                while (len < maxLen && data[c + len] == data[pos + len])
+                    len++;
+                if (len > bestLen)
+                {
+                    bestLen = len;
+                    bestDist = pos - c;
+                    if (len == maxLen)
+                        break;
+                }
+            next:
+                cand = prev[c % YAZ0_WINDOW];
+                // entries older than the window were overwritten by newer positions
+                if (cand != 0 && cand - 1 >= c)
+                    break;
+            }
+        }
+
+        if (bestLen < YAZ0_MIN_MATCH)
+        {
+            block->kinds[block->numItems++] = 1;
+            block->items[block->itemsSize++] = data[pos];
+            if (end - pos >= YAZ0_MIN_MATCH)
+                INSERT(pos);
+            pos++;
+            continue;
+        }
+
+        uint8_t* item = &block->items[block->itemsSize];
+        size_t dist = bestDist - 1;
+
+        block->kinds[block->numItems++] = 0;
+        if (bestLen < 0x12)
+        {
+            item[0] = (bestLen - 2) << 4 | dist >> 8;
+            item[1] = dist & 0xFF;
+            block->itemsSize += 2;
+        }
+        else
+        {
+            item[0] = dist >> 8;
+            item[1] = dist & 0xFF;
+            item[2] = bestLen - 0x12;
+            block->itemsSize += 3;
+        }
+
+        for (size_t i = 0; i < bestLen; i++, pos++)
+        {
+            if (enc->size - pos >= YAZ0_MIN_MATCH)
+                INSERT(pos);
+        }
+    }
+#undef INSERT
+
+end:
+    free(head);
+    free(prev);
+}
+
+/*
+ * Compresses data into a newly allocated Yaz0 file. The blocks of the input are matched on numThreads threads, the
+ * output is the same for any number of threads. Returns NULL if out of memory.
+ */
+void*
+Yaz0_Encode (const void* data, size_t size, int numThreads, size_t* outSize)
+{
+    Yaz0Encoder enc = { data, size, NULL, (size + YAZ0_BLOCK_SIZE - 1) / YAZ0_BLOCK_SIZE };
+    // a code byte for every 8 literals is the most the data can grow by
+    size_t capacity = YAZ0_HEADER_SIZE + size + (size + 7) / 8;
+    uint8_t* out = malloc(capacity);
+    size_t o = YAZ0_HEADER_SIZE;
+    size_t codePos = 0;
+    int bit = 8;
+
+    enc.blocks = calloc(enc.numBlocks + 1, sizeof(Yaz0Block));
+    if (out == NULL || enc.blocks == NULL)
+        goto fail;
+
+    if (numThreads > 1 && enc.numBlocks > 1)
+    {
+        if (WorkPool_Run(enc.numBlocks, numThreads, Yaz0_EncodeBlock, &enc) != 0)
+            goto fail;
+    }
+    else
+    {
+        for (size_t i = 0; i < enc.numBlocks; i++)
+            Yaz0_EncodeBlock(i, 0, &enc);
+    }
+    for (size_t i = 0; i < enc.numBlocks; i++)
+    {
+        if (enc.blocks[i].failed)
+            goto fail;
+    }
+
+    memcpy(out, "Yaz0", 4);
+    WRITE_32_BE(out, 4, size);
+    memset(out + 8, 0, 8);
+
+    for (size_t i = 0; i < enc.numBlocks; i++)
+    {
+        const Yaz0Block* block = &enc.blocks[i];
+        const uint8_t* item = block->items;
+
+        for (size_t j = 0; j < block->numItems; j++)
+        {
+            if (bit == 8)
+            {
+                codePos = o++;
+                out[codePos] = 0;
+                bit = 0;
+            }
+
+            size_t len = block->kinds[j] ? 1 : (item[0] >> 4) ? 2 : 3;
+
+            out[codePos] |= block->kinds[j] << (7 - bit++);
+            memcpy(&out[o], item, len);
+            o += len;
+            item += len;
+        }
+    }
+
+    for (size_t i = 0; i < enc.numBlocks; i++)
+    {
+        free(enc.blocks[i].kinds);
+        free(enc.blocks[i].items);
+    }
+    free(enc.blocks);
+    *outSize = o;
+    return out;
+fail:
+    for (size_t i = 0; enc.blocks != NULL && i < enc.numBlocks; i++)
+    {
+        free(enc.blocks[i].kinds);
+        free(enc.blocks[i].items);
+    }
+    free(enc.blocks);
+    free(out);
+    return NULL;
+}
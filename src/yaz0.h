@@ -0,0 +1,22 @@
+#ifndef YAZ0_H_
+#define YAZ0_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define YAZ0_HEADER_SIZE 16
+
+bool
+Yaz0_IsCompressed (const void* data, size_t size);
+
+size_t
+Yaz0_DecodedSize (const void* data);
+
+int
+Yaz0_Decode (const void* src, size_t srcSize, void* dst, size_t dstSize);
+
+void*
+Yaz0_Encode (const void* data, size_t size, int numThreads, size_t* outSize);
+
+#endif
@@ -1,136 +1,691 @@
 #include <errno.h>
-#include <stdarg.h>
+#include <fcntl.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "errmsg.h"
 #include "macros.h"
 #include "segment.h"
+#include "yaz0.h"
 #include "zobj.h"
 
-NORETURN static void
-Fatal (const char *fmt, ...)
+/*
+ * Reads a whole file into a new buffer, an empty file gives a NULL buffer and a size of 0
+ */
+static int
+ReadBinFile (const char* filename, void** bufferOut, size_t* sizeOut)
 {
-    va_list args;
+    FILE* file = fopen(filename, "rb");
+    uint8_t* buffer = NULL;
+    struct stat st;
+    size_t size;
 
-    fputs("error: ", stderr);
+    if (file == NULL)
+        return DisplayList_ErrMsgSet("Failed to open file '%s' for reading: %s\n", filename, strerror(errno));
 
-    va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
-    va_end(args);
+    // a directory opens fine but has no size to read
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        fclose(file);
+        return DisplayList_ErrMsgSet("'%s' is not a regular file\n", filename);
+    }
+    size = st.st_size;
 
-    fputc('\n', stderr);
+    // if the file is empty, return NULL buffer and 0 size
+    if (size != 0)
+    {
+        // allocate buffer
+        buffer = malloc(size);
+        if (buffer == NULL)
+        {
+            fclose(file);
+            return DisplayList_ErrMsgSet("Could not allocate buffer for file '%s'\n", filename);
+        }
+
+        // read file
+        if (fread(buffer, size, 1, file) != 1)
+        {
+            fclose(file);
+            free(buffer);
+            return DisplayList_ErrMsgSet("Error reading from file '%s': %s\n", filename, strerror(errno));
+        }
+    }
+    fclose(file);
 
-    exit(EXIT_FAILURE);
+    *bufferOut = buffer;
+    *sizeOut = size;
+    return 0;
 }
 
-static void*
-ReadBinFile (const char* filename, size_t* sizeOut)
-{
-    FILE* file = fopen(filename, "rb");
-    uint8_t* buffer = NULL;
+struct ZObjMapping {
+    void* addr;
     size_t size;
+    atomic_int refCount;
+};
 
-    if (file == NULL)
-        Fatal("failed to open file '%s' for reading: %s", filename, strerror(errno));
+static ZObjMapping*
+MapBinFile (const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    ZObjMapping* mapping;
+    struct stat st;
 
-    // get size
-    fseek(file, 0, SEEK_END);
-    size = ftell(file);
+    if (fd < 0)
+    {
+        DisplayList_ErrMsgSet("Failed to open file '%s' for reading: %s\n", filename, strerror(errno));
+        return NULL;
+    }
 
-    // if the file is empty, return NULL buffer and 0 size
-    if (size == 0)
-        goto end;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        DisplayList_ErrMsgSet("'%s' is not a regular file\n", filename);
+        return NULL;
+    }
 
-    // allocate buffer
-    buffer = malloc(size);
-    if (buffer == NULL)
-        Fatal("could not allocate buffer for file '%s'", filename);
+    mapping = malloc(sizeof(ZObjMapping));
+    if (mapping == NULL)
+    {
+        close(fd);
+        DisplayList_ErrMsgSet("Could not allocate mapping for file '%s'\n", filename);
+        return NULL;
+    }
 
-    // read file
-    fseek(file, 0, SEEK_SET);
-    if (fread(buffer, size, 1, file) != 1)
-        Fatal("error reading from file '%s': %s", filename, strerror(errno));
+    mapping->addr = NULL;
+    mapping->size = st.st_size;
+    atomic_init(&mapping->refCount, 1);
 
-    fclose(file);
+    // an empty file cannot be mapped, leave it with a NULL buffer like ReadBinFile does
+    if (mapping->size != 0)
+    {
+        mapping->addr = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping->addr == MAP_FAILED)
+        {
+            DisplayList_ErrMsgSet("Failed to map file '%s': %s\n", filename, strerror(errno));
+            close(fd);
+            free(mapping);
+            return NULL;
+        }
+    }
 
-end:
-    if (sizeOut != NULL)
-        *sizeOut = size;
-    return buffer;
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    return mapping;
 }
 
 static void
+MappingRelease (ZObjMapping* mapping)
+{
+    if (atomic_fetch_sub(&mapping->refCount, 1) != 1)
+        return;
+
+    if (mapping->addr != NULL)
+        munmap(mapping->addr, mapping->size);
+    free(mapping);
+}
+
+static int
 WriteBinFile(const char* filename, const void* data, size_t size)
 {
     FILE* file = fopen(filename, "wb");
 
     if (file == NULL)
-        Fatal("failed to open file '%s' for writing: %s", filename, strerror(errno));
+        return DisplayList_ErrMsgSet("Failed to open file '%s' for writing: %s\n", filename, strerror(errno));
 
-    if (fwrite(data, size, 1, file) != 1)
-        Fatal("error writing to file '%s': %s", filename, strerror(errno));
+    bool failed = (size != 0 && fwrite(data, size, 1, file) != 1);
 
-    fclose(file);
+    if (fclose(file) != 0 || failed)
+        return DisplayList_ErrMsgSet("Error writing to file '%s': %s\n", filename, strerror(errno));
+    return 0;
 }
 
-int
-ZObj_New (ZObj* zobj, int segNum)
+struct ZObjChunk {
+    size_t offset;      // offset in the object of the first byte of data
+    size_t size;        // bytes handed out so far
+    size_t capacity;
+    uint8_t data[];
+};
+
+static int
+WriteBinFileChunks(const char* filename, ZObjChunk* const* chunks, size_t numChunks)
 {
-    SEGMENT_NUMBER_ASSERT(segNum);
+    FILE* file = fopen(filename, "wb");
+    bool failed = false;
+
+    if (file == NULL)
+        return DisplayList_ErrMsgSet("Failed to open file '%s' for writing: %s\n", filename, strerror(errno));
+
+    for (size_t i = 0; i < numChunks && !failed; i++)
+        failed = (chunks[i]->size != 0 && fwrite(chunks[i]->data, chunks[i]->size, 1, file) != 1);
+
+    if (fclose(file) != 0 || failed)
+        return DisplayList_ErrMsgSet("Error writing to file '%s': %s\n", filename, strerror(errno));
+    return 0;
+}
+
+/*
+ * Finds the chunk holding the given offset of a chunked object
+ */
+static size_t
+ChunkFind (const ZObj* zobj, size_t offset)
+{
+    size_t lo = 0;
+    size_t hi = zobj->numChunks;
+
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+
+        if (zobj->chunks[mid]->offset <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static inline uint8_t*
+DataAt (const ZObj* zobj, size_t offset)
+{
+    if (zobj->chunkSize == 0)
+        return (uint8_t*)zobj->buffer + offset;
+
+    ZObjChunk* chunk = zobj->chunks[ChunkFind(zobj, offset)];
+    return chunk->data + (offset - chunk->offset);
+}
+
+/*
+ * Compares size bytes of data with the object contents at offset, which may span several chunks
+ */
+static bool
+DataEquals (const ZObj* zobj, size_t offset, const void* data, size_t size)
+{
+    const uint8_t* s = data;
 
+    if (zobj->chunkSize == 0)
+        return memcmp((uint8_t*)zobj->buffer + offset, data, size) == 0;
+
+    for (size_t i = ChunkFind(zobj, offset); size != 0; i++)
+    {
+        ZObjChunk* chunk = zobj->chunks[i];
+        size_t n = chunk->offset + chunk->size - offset;
+
+        if (n > size)
+            n = size;
+        if (memcmp(chunk->data + (offset - chunk->offset), s, n) != 0)
+            return false;
+        offset += n;
+        s += n;
+        size -= n;
+    }
+    return true;
+}
+
+#define INDEX_MIN_BUCKETS 1024
+
+static inline size_t
+IndexHash (const ZObjIndex* index, const void* data)
+{
+    uint64_t word;
+
+    memcpy(&word, data, sizeof(word));
+    return (word * 0x9E3779B97F4A7C15ULL) >> 32 & (index->numBuckets - 1);
+}
+
+static void
+IndexInit (ZObjIndex* index)
+{
+    index->heads = index->tails = index->next = NULL;
+    index->numBuckets = index->numSlots = index->slotCapacity = 0;
+}
+
+static void
+IndexFree (ZObjIndex* index)
+{
+    free(index->heads);
+    free(index->tails);
+    free(index->next);
+    IndexInit(index);
+}
+
+static void
+IndexLink (ZObjIndex* index, const ZObj* zobj, size_t slot)
+{
+    size_t bucket = IndexHash(index, DataAt(zobj, slot * 8));
+
+    index->next[slot] = 0;
+    if (index->heads[bucket] == 0)
+        index->heads[bucket] = slot + 1;
+    else
+        index->next[index->tails[bucket] - 1] = slot + 1;
+    index->tails[bucket] = slot + 1;
+}
+
+static int
+IndexRehash (ZObjIndex* index, const ZObj* zobj, size_t numBuckets)
+{
+    free(index->heads);
+    free(index->tails);
+
+    index->numBuckets = numBuckets;
+    index->heads = calloc(numBuckets, sizeof(uint32_t));
+    index->tails = calloc(numBuckets, sizeof(uint32_t));
+    if (index->heads == NULL || index->tails == NULL)
+        return -1;
+
+    // relink in ascending order so that every chain stays sorted by offset
+    for (size_t slot = 0; slot < index->numSlots; slot++)
+        IndexLink(index, zobj, slot);
+    return 0;
+}
+
+/*
+ * Index every aligned word that is fully inside the object and has not been indexed yet. If out of memory the index
+ * is dropped, so the object is indexed from scratch on the next search, and -1 is returned.
+ */
+static int
+IndexUpdate (ZObjIndex* index, const ZObj* zobj)
+{
+    size_t numSlots = zobj->limit / 8;
+
+    if (numSlots <= index->numSlots)
+        return 0;
+
+    if (numSlots > index->slotCapacity)
+    {
+        size_t newCapacity = (index->slotCapacity == 0) ? numSlots : index->slotCapacity * 2;
+        uint32_t* next;
+
+        if (newCapacity < numSlots)
+            newCapacity = numSlots;
+
+        next = realloc(index->next, newCapacity * sizeof(uint32_t));
+        if (next == NULL)
+            goto nomem;
+        index->next = next;
+        index->slotCapacity = newCapacity;
+    }
+
+    if (numSlots > index->numBuckets)
+    {
+        size_t numBuckets = (index->numBuckets == 0) ? INDEX_MIN_BUCKETS : index->numBuckets;
+        while (numBuckets < numSlots)
+            numBuckets *= 2;
+        if (IndexRehash(index, zobj, numBuckets) != 0)
+            goto nomem;
+    }
+
+    for (size_t slot = index->numSlots; slot < numSlots; slot++)
+        IndexLink(index, zobj, slot);
+    index->numSlots = numSlots;
+    return 0;
+nomem:
+    IndexFree(index);
+    return -1;
+}
+
+/*
+ * Hash of the whole contents of an object, to tell whether a saved index still belongs to it
+ */
+static uint64_t
+ContentsHash (const ZObj* zobj)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL ^ zobj->limit;
+    size_t offset = 0;
+
+    while (offset < zobj->limit)
+    {
+        const uint8_t* data = DataAt(zobj, offset);
+        size_t size = zobj->limit - offset;
+        size_t i;
+
+        if (zobj->chunkSize != 0)
+        {
+            ZObjChunk* chunk = zobj->chunks[ChunkFind(zobj, offset)];
+            size = chunk->offset + chunk->size - offset;
+        }
+
+        // chunks and the object hold a whole number of words except maybe at the very end
+        for (i = 0; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+            hash ^= hash >> 29;
+        }
+        for (; i < size; i++)
+            hash = (hash ^ data[i]) * 0x100000001B3ULL;
+        offset += size;
+    }
+    return hash;
+}
+
+static void
+ZObjInit (ZObj* zobj, int segNum)
+{
     zobj->buffer = NULL;
     zobj->limit = zobj->capacity = 0;
     zobj->segmentNumber = segNum;
+    IndexInit(&zobj->index);
+    zobj->mapping = NULL;
+    zobj->readOnly = false;
+    zobj->chunks = NULL;
+    zobj->numChunks = zobj->chunkSize = 0;
+    zobj->compression = ZOBJ_COMPRESSION_NONE;
+    zobj->compressThreads = 1;
+}
+
+/*
+ * Replaces a Yaz0 compressed buffer read from a file with its decompressed contents, decoding straight out of the
+ * file buffer or mapping so that the compressed file is never copied. On failure the object is freed, since this runs
+ * on the threads of any caller the error is reported rather than exiting.
+ */
+static int
+ZObjDecompress (ZObj* zobj, const char* path)
+{
+    uint8_t* buffer;
+    size_t size;
+
+    if (!Yaz0_IsCompressed(zobj->buffer, zobj->limit))
+        return 0;
+
+    size = Yaz0_DecodedSize(zobj->buffer);
+    buffer = malloc((size == 0) ? 1 : size);
+    if (buffer == NULL)
+    {
+        ZObj_Free(zobj);
+        return DisplayList_ErrMsgSet("Could not allocate buffer of %lu bytes to decompress file '%s'\n", size, path);
+    }
+
+    if (Yaz0_Decode(zobj->buffer, zobj->limit, buffer, size) != 0)
+    {
+        free(buffer);
+        ZObj_Free(zobj);
+        return DisplayList_ErrMsgSet("File '%s' is not valid Yaz0 data\n", path);
+    }
+
+    if (zobj->mapping != NULL)
+        MappingRelease(zobj->mapping);
+    else
+        free(zobj->buffer);
+
+    zobj->buffer = buffer;
+    zobj->limit = zobj->capacity = size;
+    zobj->mapping = NULL;
+    zobj->readOnly = false;
+    zobj->compression = ZOBJ_COMPRESSION_YAZ0;
+    return 0;
+}
+
+int
+ZObj_New (ZObj* zobj, int segNum)
+{
+    SEGMENT_NUMBER_ASSERT(segNum);
+
+    ZObjInit(zobj, segNum);
+    return 0;
+}
+
+/*
+ * Creates an empty object that allocates from a list of chunks of at least chunkSize bytes (ZOBJ_DEFAULT_CHUNK_SIZE if
+ * 0) instead of one buffer. Growing never moves existing contents, so pointers returned by ZObj_Alloc stay valid until
+ * the object is flattened or freed.
+ */
+int
+ZObj_NewChunked (ZObj* zobj, int segNum, size_t chunkSize)
+{
+    SEGMENT_NUMBER_ASSERT(segNum);
+
+    ZObjInit(zobj, segNum);
+    zobj->chunkSize = (chunkSize == 0) ? ZOBJ_DEFAULT_CHUNK_SIZE : ALIGN8(chunkSize);
     return 0;
 }
 
 int
 ZObj_Free (ZObj* zobj)
 {
-    if (zobj->buffer != NULL)
+    if (zobj->mapping != NULL)
+        MappingRelease(zobj->mapping);
+    else if (zobj->buffer != NULL && !zobj->readOnly)
         free(zobj->buffer);
-    zobj->buffer = NULL;
-    zobj->limit = zobj->capacity = 0;
-    zobj->segmentNumber = 0;
+    for (size_t i = 0; i < zobj->numChunks; i++)
+        free(zobj->chunks[i]);
+    free(zobj->chunks);
+    IndexFree(&zobj->index);
+    ZObjInit(zobj, 0);
     return 0;
 }
 
+/*
+ * Reads a file into memory, decompressing it if it is Yaz0 compressed. Fails with an error message if the file cannot
+ * be read or decompressed, returns 1 without one if it is empty.
+ */
 int
 ZObj_Read (ZObj* zobj, const char* path, int segNum)
 {
     SEGMENT_NUMBER_ASSERT(segNum);
 
-    zobj->buffer = ReadBinFile(path, &zobj->limit);
+    ZObjInit(zobj, segNum);
+    if (ReadBinFile(path, &zobj->buffer, &zobj->limit) != 0)
+        return -1;
     zobj->capacity = zobj->limit;
-    zobj->segmentNumber = segNum;
+    if (ZObjDecompress(zobj, path) != 0)
+        return -1;
+    return zobj->buffer == NULL;
+}
+
+/*
+ * Maps a file read-only instead of reading it into memory, for objects that are only ever copied from.
+ * ZObj_Alloc fails on the resulting object. Yaz0 compressed files are decompressed into memory instead, which leaves
+ * the object writable. Like ZObj_Read, fails with an error message if the file cannot be mapped or is compressed but
+ * cannot be decompressed.
+ */
+int
+ZObj_Map (ZObj* zobj, const char* path, int segNum)
+{
+    SEGMENT_NUMBER_ASSERT(segNum);
+
+    ZObjInit(zobj, segNum);
+    zobj->mapping = MapBinFile(path);
+    if (zobj->mapping == NULL)
+        return -1;
+    zobj->buffer = zobj->mapping->addr;
+    zobj->limit = zobj->capacity = zobj->mapping->size;
+    zobj->readOnly = true;
+    if (ZObjDecompress(zobj, path) != 0)
+        return -1;
     return zobj->buffer == NULL;
 }
 
+/*
+ * Creates a read-only object over size bytes of another object starting at offset, without copying. If the other
+ * object is mapped the view holds a reference to the mapping and may outlive it, otherwise the view borrows its buffer
+ * and must be freed first.
+ */
+int
+ZObj_View (ZObj* view, const ZObj* zobj, size_t offset, size_t size, int segNum)
+{
+    SEGMENT_NUMBER_ASSERT(segNum);
+
+    // a chunked object has to be flattened before it can be viewed
+    if (zobj->chunkSize != 0 || offset > zobj->limit || size > zobj->limit - offset)
+        return -1;
+
+    ZObjInit(view, segNum);
+    view->buffer = (zobj->buffer == NULL) ? NULL : (uint8_t*)zobj->buffer + offset;
+    view->limit = view->capacity = size;
+    view->mapping = zobj->mapping;
+    view->readOnly = true;
+
+    if (view->mapping != NULL)
+        atomic_fetch_add(&view->mapping->refCount, 1);
+    return 0;
+}
+
+/*
+ * Writes the object out Yaz0 compressed, a chunked object is gathered into one buffer for the encoder first
+ */
+static int
+ZObjWriteCompressed (ZObj* zobj, const char* path)
+{
+    uint8_t* data = zobj->buffer;
+    uint8_t* compressed;
+    size_t size;
+    int ret;
+
+    if (zobj->chunkSize != 0)
+    {
+        data = malloc((zobj->limit == 0) ? 1 : zobj->limit);
+        if (data == NULL)
+            return DisplayList_ErrMsgSet("Could not allocate buffer to compress file '%s'\n", path);
+        for (size_t i = 0; i < zobj->numChunks; i++)
+            memcpy(data + zobj->chunks[i]->offset, zobj->chunks[i]->data, zobj->chunks[i]->size);
+    }
+
+    compressed = Yaz0_Encode(data, zobj->limit, zobj->compressThreads, &size);
+    ret = (compressed == NULL) ? DisplayList_ErrMsgSet("Could not compress file '%s'\n", path)
+                               : WriteBinFile(path, compressed, size);
+
+    free(compressed);
+    if (data != zobj->buffer)
+        free(data);
+    return ret;
+}
+
+/*
+ * Writes the object to a file, returns -1 with an error message if it cannot be written
+ */
 int
 ZObj_Write (ZObj* zobj, const char* path)
 {
-    WriteBinFile(path, zobj->buffer, zobj->limit);
+    if (zobj->compression == ZOBJ_COMPRESSION_YAZ0)
+        return ZObjWriteCompressed(zobj, path);
+
+    // chunks are written one after another rather than gathered into one buffer first
+    if (zobj->chunkSize != 0)
+        return WriteBinFileChunks(path, zobj->chunks, zobj->numChunks);
+    return WriteBinFile(path, zobj->buffer, zobj->limit);
+}
+
+/*
+ * Moves the contents of a chunked object into a single buffer, after which it behaves like any other object. This
+ * invalidates all pointers into the chunks.
+ */
+int
+ZObj_Flatten (ZObj* zobj)
+{
+    uint8_t* buffer;
+
+    if (zobj->chunkSize == 0)
+        return 0;
+
+    buffer = malloc((zobj->limit == 0) ? 1 : zobj->limit);
+    if (buffer == NULL)
+        return -1;
+
+    for (size_t i = 0; i < zobj->numChunks; i++)
+    {
+        memcpy(buffer + zobj->chunks[i]->offset, zobj->chunks[i]->data, zobj->chunks[i]->size);
+        free(zobj->chunks[i]);
+    }
+    free(zobj->chunks);
+
+    zobj->chunks = NULL;
+    zobj->numChunks = zobj->chunkSize = 0;
+    zobj->buffer = buffer;
+    zobj->capacity = zobj->limit;
+    return 0;
+}
+
+/*
+ * Shortens an object whose contents were rearranged in place to its first limit bytes. The duplicate index no longer
+ * matches the contents and is rebuilt on the next search.
+ */
+int
+ZObj_Truncate (ZObj* zobj, size_t limit)
+{
+    if (zobj->readOnly || zobj->chunkSize != 0 || limit > zobj->limit)
+        return -1;
+
+    zobj->limit = limit;
+    IndexFree(&zobj->index);
     return 0;
 }
 
+static void*
+ChunkAlloc (ZObj* zobj, size_t size)
+{
+    ZObjChunk* chunk = (zobj->numChunks == 0) ? NULL : zobj->chunks[zobj->numChunks - 1];
+
+    // start a new chunk when the last one is full, the unused end of the old one is not part of the object
+    if (chunk == NULL || chunk->capacity - chunk->size < size)
+    {
+        size_t capacity = (size > zobj->chunkSize) ? size : zobj->chunkSize;
+        ZObjChunk** chunks = realloc(zobj->chunks, (zobj->numChunks + 1) * sizeof(ZObjChunk*));
+
+        if (chunks == NULL)
+            return NULL;
+        zobj->chunks = chunks;
+
+        chunk = malloc(sizeof(ZObjChunk) + capacity);
+        if (chunk == NULL)
+            return NULL;
+
+        chunk->offset = zobj->limit;
+        chunk->size = 0;
+        chunk->capacity = capacity;
+        zobj->chunks[zobj->numChunks++] = chunk;
+        zobj->capacity += capacity;
+    }
+
+    void* ptr = chunk->data + chunk->size;
+    chunk->size += size;
+    return ptr;
+}
+
 void*
 ZObj_Alloc (ZObj* zobj, size_t size)
 {
     size_t oldSize = zobj->limit;
+    size_t newSize = oldSize + ALIGN8(size);
+    void* ptr;
 
-    zobj->limit += ALIGN8(size);
+    if (zobj->readOnly)
+        return NULL;
 
-    if (zobj->buffer == NULL || zobj->limit > zobj->capacity)
+    if (zobj->chunkSize != 0)
     {
-        zobj->capacity = zobj->limit * 2;
-        zobj->buffer = realloc(zobj->buffer, zobj->capacity);
-        memset((uint8_t*)zobj->buffer + oldSize, 0, zobj->limit - oldSize);
+        ptr = ChunkAlloc(zobj, newSize - oldSize);
+        if (ptr == NULL)
+            return NULL;
+    }
+    else
+    {
+        if (zobj->buffer == NULL || newSize > zobj->capacity)
+        {
+            size_t newCapacity = (newSize < 32) ? 64 : newSize * 2;
+            void* newBuffer = realloc(zobj->buffer, newCapacity);
+
+            if (newBuffer == NULL)
+                return NULL;
+            zobj->buffer = newBuffer;
+            zobj->capacity = newCapacity;
+        }
+        ptr = (uint8_t*)zobj->buffer + oldSize;
     }
 
-    return (uint8_t*)zobj->buffer + oldSize;
+    // clear the whole new region including alignment padding, reused capacity may hold stale bytes
+    memset(ptr, 0, newSize - oldSize);
+    zobj->limit = newSize;
+    return ptr;
 }
 
 bool
@@ -142,6 +697,18 @@ ZObj_AddressValid (ZObj* zobj, uint32_t segAddr)
 segaddr_t
 ZObj_ToSegment (ZObj* zobj, void* ptr)
 {
+    if (zobj->chunkSize != 0)
+    {
+        for (size_t i = 0; i < zobj->numChunks; i++)
+        {
+            ZObjChunk* chunk = zobj->chunks[i];
+
+            if ((uint8_t*)ptr >= chunk->data && (uint8_t*)ptr < chunk->data + chunk->size)
+                return SEGMENT_ADDR(zobj->segmentNumber, chunk->offset + ((uint8_t*)ptr - chunk->data));
+        }
+        return -1;
+    }
+
     if (ptr < zobj->buffer || (uint8_t*)ptr >= (uint8_t*)zobj->buffer + zobj->limit)
         return -1;
 
@@ -159,24 +726,145 @@ ZObj_FromSegment (ZObj* zobj, segaddr_t segAddr)
     if (segNum != zobj->segmentNumber)
         return NULL;
 
-    return (uint8_t*)zobj->buffer + offset;
+    if (offset >= zobj->limit)
+        return NULL;
+
+    // a pointer into a chunk is only valid up to the end of that chunk
+    return DataAt(zobj, offset);
 }
 
 void*
 ZObj_SearchDuplicate (ZObj * zobj, const void* data, size_t size)
 {
     const uint8_t* s = data;
-    uint8_t* p = zobj->buffer;
+    size_t offset;
 
-    if (data == NULL || zobj->buffer == NULL || size == 0)
+    if (data == NULL || zobj->limit == 0 || size == 0)
         return NULL;
 
-    while (zobj->limit - (p - (uint8_t*)zobj->buffer) >= size)
+    if (size >= 8)
     {
-        if (p[0] == s[0] && memcmp(p, data, size) == 0)
-            return p;
-        p += 8;
+        ZObjIndex* index = &zobj->index;
+
+        // without an index nothing is found, the copy just goes without deduplicating this data
+        if (IndexUpdate(index, zobj) != 0 || index->numSlots == 0)
+            return NULL;
+
+        // candidates share the first word with the data and are visited lowest offset first
+        uint32_t slot = index->heads[IndexHash(index, data)];
+        while (slot != 0)
+        {
+            offset = (slot - 1) * 8;
+            if (zobj->limit - offset < size)
+                break;
+            if (DataEquals(zobj, offset, data, size))
+                return DataAt(zobj, offset);
+            slot = index->next[slot - 1];
+        }
+        return NULL;
+    }
+
+    // too small to be keyed by a whole word, scan every aligned offset
+    for (offset = 0; zobj->limit - offset >= size; offset += 8)
+    {
+        if (*DataAt(zobj, offset) == s[0] && DataEquals(zobj, offset, data, size))
+            return DataAt(zobj, offset);
     }
 
     return NULL;
 }
+
+#define INDEX_FILE_MAGIC 0x3158444A424F5A00ULL  // "\0ZOBJDX1"
+
+typedef struct IndexFileHeader {
+    uint64_t magic;
+    uint64_t limit;
+    uint64_t contentsHash;
+    uint64_t numBuckets;
+    uint64_t numSlots;
+} IndexFileHeader;
+
+/*
+ * Writes the duplicate index to file along with the size and a hash of the contents it indexes, so that a later run
+ * that reads the object back can load it with ZObj_ReadIndex rather than index the whole object again.
+ */
+int
+ZObj_WriteIndex (ZObj* zobj, FILE* file)
+{
+    ZObjIndex* index = &zobj->index;
+    IndexFileHeader header;
+
+    if (IndexUpdate(index, zobj) != 0)
+        return -1;
+
+    header.magic = INDEX_FILE_MAGIC;
+    header.limit = zobj->limit;
+    header.contentsHash = ContentsHash(zobj);
+    header.numBuckets = index->numBuckets;
+    header.numSlots = index->numSlots;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        return -1;
+    if (index->numSlots == 0)
+        return 0;
+    if (fwrite(index->heads, sizeof(uint32_t), index->numBuckets, file) != index->numBuckets ||
+        fwrite(index->tails, sizeof(uint32_t), index->numBuckets, file) != index->numBuckets ||
+        fwrite(index->next, sizeof(uint32_t), index->numSlots, file) != index->numSlots)
+        return -1;
+    return 0;
+}
+
+/*
+ * Loads an index written by ZObj_WriteIndex. Fails without changing the object if the index was written for different
+ * contents, the object is then indexed on first search as usual.
+ */
+int
+ZObj_ReadIndex (ZObj* zobj, FILE* file)
+{
+    ZObjIndex index;
+    IndexFileHeader header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != INDEX_FILE_MAGIC ||
+        header.limit != zobj->limit || header.numSlots != zobj->limit / 8 ||
+        (header.numSlots != 0 && (header.numBuckets < header.numSlots ||
+                                  (header.numBuckets & (header.numBuckets - 1)) != 0)) ||
+        header.contentsHash != ContentsHash(zobj))
+        return -1;
+    if (header.numSlots == 0)
+        return 0;
+
+    IndexInit(&index);
+    index.numBuckets = header.numBuckets;
+    index.numSlots = index.slotCapacity = header.numSlots;
+    index.heads = malloc(index.numBuckets * sizeof(uint32_t));
+    index.tails = malloc(index.numBuckets * sizeof(uint32_t));
+    index.next = malloc(index.numSlots * sizeof(uint32_t));
+
+    if (index.heads == NULL || index.tails == NULL || index.next == NULL ||
+        fread(index.heads, sizeof(uint32_t), index.numBuckets, file) != index.numBuckets ||
+        fread(index.tails, sizeof(uint32_t), index.numBuckets, file) != index.numBuckets ||
+        fread(index.next, sizeof(uint32_t), index.numSlots, file) != index.numSlots)
+    {
+        IndexFree(&index);
+        return -1;
+    }
+
+    // a damaged file must not send searches outside the object
+    for (size_t i = 0; i < index.numBuckets; i++)
+    {
+        if (index.heads[i] > index.numSlots || index.tails[i] > index.numSlots)
+            goto bad;
+    }
+    for (size_t i = 0; i < index.numSlots; i++)
+    {
+        if (index.next[i] > index.numSlots || (index.next[i] != 0 && index.next[i] <= i + 1))
+            goto bad;
+    }
+
+    IndexFree(&zobj->index);
+    zobj->index = index;
+    return 0;
+bad:
+    IndexFree(&index);
+    return -1;
+}
@@ -2,29 +2,84 @@
 #define ZOBJ_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "segment.h"
 
+/*
+ * Index over the 8-byte aligned words of an object, used to find duplicate data without scanning the whole buffer.
+ * Every aligned offset is chained into a bucket selected by the hash of the 8 bytes found there, chains are kept in
+ * ascending offset order. The index is brought up to date lazily on search, so any memory obtained with ZObj_Alloc
+ * must be filled in before the next call to ZObj_SearchDuplicate and not changed afterwards.
+ */
+typedef struct ZObjIndex {
+    uint32_t* heads;    // first slot + 1 in each bucket, 0 if the bucket is empty
+    uint32_t* tails;    // last slot + 1 in each bucket
+    uint32_t* next;     // next slot + 1 in the same bucket as each slot
+    size_t numBuckets;
+    size_t numSlots;    // number of aligned words indexed so far
+    size_t slotCapacity;
+} ZObjIndex;
+
+// Read-only file mapping, shared by every object that views it
+typedef struct ZObjMapping ZObjMapping;
+
+// Block of memory that a chunked object hands out space from
+typedef struct ZObjChunk ZObjChunk;
+
+typedef enum ZObjCompression {
+    ZOBJ_COMPRESSION_NONE,
+    ZOBJ_COMPRESSION_YAZ0,
+} ZObjCompression;
+
 typedef struct ZObj {
     void* buffer;
     size_t limit;
     size_t capacity;
     int segmentNumber;
+    ZObjIndex index;
+    ZObjMapping* mapping;   // mapping backing the buffer, NULL if the buffer is not mapped
+    bool readOnly;          // buffer is mapped or borrowed from another object and cannot be written or grown
+    // Chunked objects have no single buffer, their contents are spread over chunks in ascending offset order
+    ZObjChunk** chunks;
+    size_t numChunks;
+    size_t chunkSize;       // minimum size of a new chunk, 0 if the object is not chunked
+    // How ZObj_Write stores the object, set by ZObj_Read and ZObj_Map from the file they load
+    ZObjCompression compression;
+    int compressThreads;    // threads searching for matches when compressing, 1 to compress on the calling thread
 } ZObj;
 
+#define ZOBJ_DEFAULT_CHUNK_SIZE 0x100000
+
 int
 ZObj_New (ZObj* zobj, int segNum);
 
+int
+ZObj_NewChunked (ZObj* zobj, int segNum, size_t chunkSize);
+
 int
 ZObj_Free (ZObj* zobj);
 
 int
 ZObj_Read (ZObj* zobj, const char* path, int segNum);
 
+int
+ZObj_Map (ZObj* zobj, const char* path, int segNum);
+
+int
+ZObj_View (ZObj* view, const ZObj* zobj, size_t offset, size_t size, int segNum);
+
 int
 ZObj_Write (ZObj* zobj, const char* path);
 
+int
+ZObj_Flatten (ZObj* zobj);
+
+int
+ZObj_Truncate (ZObj* zobj, size_t limit);
+
 void*
 ZObj_Alloc (ZObj* zobj, size_t size);
 
@@ -40,4 +95,10 @@ ZObj_FromSegment (ZObj* zobj, segaddr_t segAddr);
 void*
 ZObj_SearchDuplicate (ZObj* zobj, const void* data, size_t size);
 
+int
+ZObj_WriteIndex (ZObj* zobj, FILE* file);
+
+int
+ZObj_ReadIndex (ZObj* zobj, FILE* file);
+
 #endif